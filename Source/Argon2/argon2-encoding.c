@@ -0,0 +1,304 @@
+/*
+ * Argon2 source code package
+ *
+ * This work is licensed under a Creative Commons CC0 1.0 License/Waiver.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+
+
+#include "argon2.h"
+#include "argon2-core.h"
+
+
+/*
+ * Encoded hashes: $argon2<type>$v=<version>$m=<m_cost>,t=<t_cost>,p=<lanes>$<salt>$<tag>
+ * with the salt and the tag in base64 without padding. Nothing is allocated: the encoder writes into the caller's buffer,
+ * and the decoder decodes the salt and tag in place, as base64 is longer than the bytes it encodes
+ */
+
+static const char* type_names[] = {"d", "i", "di", "id", "ds"};
+
+static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/* Length of the base64 encoding of @a length bytes, without padding */
+static size_t Base64Length(size_t length) {
+    return length / 3 * 4 + (length % 3 != 0) + (length % 3);
+}
+
+/* Number of decimal digits of @a value */
+static size_t DecimalLength(uint32_t value) {
+    size_t digits = 1;
+    while (value >= 10) {
+        value /= 10;
+        ++digits;
+    }
+    return digits;
+}
+
+static char* WriteString(char* out, const char* string) {
+    size_t length = strlen(string);
+    memcpy(out, string, length);
+    return out + length;
+}
+
+static char* WriteDecimal(char* out, uint32_t value) {
+    size_t digits = DecimalLength(value);
+    for (size_t i = digits; i > 0; --i) {
+        out[i - 1] = (char) ('0' + value % 10);
+        value /= 10;
+    }
+    return out + digits;
+}
+
+static char* WriteBase64(char* out, const uint8_t* in, size_t length) {
+    size_t i = 0;
+    for (; i + 3 <= length; i += 3) {
+        uint32_t bits = (uint32_t) in[i] << 16 | (uint32_t) in[i + 1] << 8 | in[i + 2];
+        *out++ = base64_alphabet[bits >> 18];
+        *out++ = base64_alphabet[(bits >> 12) & 63];
+        *out++ = base64_alphabet[(bits >> 6) & 63];
+        *out++ = base64_alphabet[bits & 63];
+    }
+    if (length - i == 1) {
+        uint32_t bits = (uint32_t) in[i] << 16;
+        *out++ = base64_alphabet[bits >> 18];
+        *out++ = base64_alphabet[(bits >> 12) & 63];
+    } else if (length - i == 2) {
+        uint32_t bits = (uint32_t) in[i] << 16 | (uint32_t) in[i + 1] << 8;
+        *out++ = base64_alphabet[bits >> 18];
+        *out++ = base64_alphabet[(bits >> 12) & 63];
+        *out++ = base64_alphabet[(bits >> 6) & 63];
+    }
+    return out;
+}
+
+/* Value of a base64 character, -1 if it is not one */
+static int Base64Value(char c) {
+    if (c >= 'A' && c <= 'Z') {
+        return c - 'A';
+    }
+    if (c >= 'a' && c <= 'z') {
+        return c - 'a' + 26;
+    }
+    if (c >= '0' && c <= '9') {
+        return c - '0' + 52;
+    }
+    if (c == '+') {
+        return 62;
+    }
+    if (c == '/') {
+        return 63;
+    }
+    return -1;
+}
+
+/*
+ * Decodes the base64 characters from @a in up to the next '$' or the end of the string, writing the bytes at @a in itself
+ * @param end Pointer receiving the pointer to the character after the base64 ones
+ * @param length Pointer receiving the number of bytes
+ * @return false if the encoding is invalid or not canonical
+ */
+static bool DecodeBase64InPlace(char* in, char** end, uint32_t* length) {
+    uint8_t* out = (uint8_t*) in;
+    uint32_t bits = 0;
+    uint32_t bit_count = 0;
+    size_t bytes = 0;
+    char* c = in;
+    for (; *c != '\0' && *c != '$'; ++c) {
+        int value = Base64Value(*c);
+        if (value < 0) {
+            return false;
+        }
+        bits = (bits << 6) | (uint32_t) value;
+        bit_count += 6;
+        if (bit_count >= 8) {
+            bit_count -= 8;
+            // The write position stays behind the read position: 3 bytes for 4 characters
+            out[bytes++] = (uint8_t) (bits >> bit_count);
+            bits &= (1U << bit_count) - 1;
+        }
+    }
+    // A single character left holds no byte, and the unused bits must be zero
+    if (bit_count >= 6 || bits != 0 || bytes > UINT32_MAX) {
+        return false;
+    }
+    *end = c;
+    *length = (uint32_t) bytes;
+    return true;
+}
+
+/* Reads the prefix @a expected at @a *in and moves past it */
+static bool ReadString(char** in, const char* expected) {
+    size_t length = strlen(expected);
+    if (strncmp(*in, expected, length) != 0) {
+        return false;
+    }
+    *in += length;
+    return true;
+}
+
+/* Reads a canonical decimal number (no sign, no leading zeros) at @a *in and moves past it */
+static bool ReadDecimal(char** in, uint32_t* value) {
+    const char* c = *in;
+    if (*c < '0' || *c > '9' || (*c == '0' && c[1] >= '0' && c[1] <= '9')) {
+        return false;
+    }
+    uint64_t number = 0;
+    for (; *c >= '0' && *c <= '9'; ++c) {
+        number = number * 10 + (uint64_t) (*c - '0');
+        if (number > UINT32_MAX) {
+            return false;
+        }
+    }
+    *value = (uint32_t) number;
+    *in = (char*) c;
+    return true;
+}
+
+size_t Argon2_EncodedLength(const Argon2_Context* context, enum Argon2_type type) {
+    if (NULL == context || type >= MAX_ARGON2_TYPE) {
+        return 0;
+    }
+    return strlen("$argon2") + strlen(type_names[type]) +
+            strlen("$v=") + DecimalLength(VERSION_NUMBER) +
+            strlen("$m=") + DecimalLength(context->m_cost) +
+            strlen(",t=") + DecimalLength(context->t_cost) +
+            strlen(",p=") + DecimalLength(context->lanes) +
+            strlen("$") + Base64Length(context->saltlen) +
+            strlen("$") + Base64Length(context->outlen) + 1;
+}
+
+int Argon2_Encode(char* encoded, size_t encodedlen, const Argon2_Context* context, enum Argon2_type type) {
+    if (NULL == encoded || NULL == context) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+    if (type >= MAX_ARGON2_TYPE) {
+        return ARGON2_INCORRECT_TYPE;
+    }
+    if (NULL == context->out) {
+        return ARGON2_OUTPUT_PTR_NULL;
+    }
+    if (NULL == context->salt && 0 != context->saltlen) {
+        return ARGON2_SALT_PTR_MISMATCH;
+    }
+    if (encodedlen < Argon2_EncodedLength(context, type)) {
+        return ARGON2_ENCODING_FAIL;
+    }
+
+    char* out = encoded;
+    out = WriteString(out, "$argon2");
+    out = WriteString(out, type_names[type]);
+    out = WriteString(out, "$v=");
+    out = WriteDecimal(out, VERSION_NUMBER);
+    out = WriteString(out, "$m=");
+    out = WriteDecimal(out, context->m_cost);
+    out = WriteString(out, ",t=");
+    out = WriteDecimal(out, context->t_cost);
+    out = WriteString(out, ",p=");
+    out = WriteDecimal(out, context->lanes);
+    out = WriteString(out, "$");
+    out = WriteBase64(out, context->salt, context->saltlen);
+    out = WriteString(out, "$");
+    out = WriteBase64(out, context->out, context->outlen);
+    *out = '\0';
+    return ARGON2_OK;
+}
+
+int Argon2_Decode(char* encoded, Argon2_Context* context, enum Argon2_type* type, const uint8_t** tag) {
+    if (NULL == encoded || NULL == context || NULL == type || NULL == tag) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+
+    // 1. Type: the whole name up to '$', as "d" and "i" are prefixes of others
+    char* in = encoded;
+    if (!ReadString(&in, "$argon2")) {
+        return ARGON2_DECODING_FAIL;
+    }
+    int found = -1;
+    for (int t = 0; t < MAX_ARGON2_TYPE && found < 0; ++t) {
+        size_t length = strlen(type_names[t]);
+        if (strncmp(in, type_names[t], length) == 0 && in[length] == '$') {
+            found = t;
+        }
+    }
+    if (found < 0) {
+        return ARGON2_DECODING_FAIL;
+    }
+    in += strlen(type_names[found]);
+
+    // 2. Version, optional, and the cost parameters
+    uint32_t version = VERSION_NUMBER;
+    uint32_t m_cost;
+    uint32_t t_cost;
+    uint32_t lanes;
+    if (ReadString(&in, "$v=") && !ReadDecimal(&in, &version)) {
+        return ARGON2_DECODING_FAIL;
+    }
+    if (VERSION_NUMBER != version) {
+        return ARGON2_DECODING_FAIL;
+    }
+    if (!ReadString(&in, "$m=") || !ReadDecimal(&in, &m_cost) ||
+            !ReadString(&in, ",t=") || !ReadDecimal(&in, &t_cost) ||
+            !ReadString(&in, ",p=") || !ReadDecimal(&in, &lanes)) {
+        return ARGON2_DECODING_FAIL;
+    }
+
+    // 3. Salt and tag, decoded where they are
+    uint8_t* salt;
+    uint32_t saltlen;
+    uint32_t taglen;
+    if (!ReadString(&in, "$")) {
+        return ARGON2_DECODING_FAIL;
+    }
+    salt = (uint8_t*) in;
+    if (!DecodeBase64InPlace(in, &in, &saltlen) || !ReadString(&in, "$")) {
+        return ARGON2_DECODING_FAIL;
+    }
+    uint8_t* decoded_tag = (uint8_t*) in;
+    if (!DecodeBase64InPlace(in, &in, &taglen) || *in != '\0' || 0 == taglen) {
+        return ARGON2_DECODING_FAIL;
+    }
+    // The hash writes outlen bytes to out: they must fit the caller's buffer and must not overwrite the salt or the tag it is compared with
+    if (taglen > context->outlen) {
+        return ARGON2_DECODING_FAIL;
+    }
+    if (NULL != context->out && (uintptr_t) context->out < (uintptr_t) in && (uintptr_t) encoded < (uintptr_t) context->out + taglen) {
+        return ARGON2_DECODING_FAIL;
+    }
+
+    // The context has constant members, so it is copied rather than assigned; the other inputs are kept
+    Argon2_Context decoded = {
+        .out = context->out,
+        .outlen = taglen,
+        .pwd = context->pwd,
+        .pwdlen = context->pwdlen,
+        .salt = salt,
+        .saltlen = saltlen,
+        .secret = context->secret,
+        .secretlen = context->secretlen,
+        .ad = context->ad,
+        .adlen = context->adlen,
+        .t_cost = t_cost,
+        .m_cost = m_cost,
+        .lanes = lanes,
+        .allocate_cbk = context->allocate_cbk,
+        .free_cbk = context->free_cbk,
+        .clear_password = context->clear_password,
+        .clear_secret = context->clear_secret,
+        .clear_memory = context->clear_memory,
+        .thread_pool = context->thread_pool,
+        .arena = context->arena,
+        .stats = context->stats,
+        .defer_wipe = context->defer_wipe
+    };
+    memcpy(context, &decoded, sizeof (Argon2_Context));
+    *type = (enum Argon2_type) found;
+    *tag = decoded_tag;
+    return ARGON2_OK;
+}
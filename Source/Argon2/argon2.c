@@ -9,10 +9,13 @@
 
 
 #include <stdint.h> 
+#include <stdlib.h>
+#include <string.h>
 
 
 #include "argon2.h"
 #include "argon2-core.h"
+#include "argon2-thread.h"
 
 
 /************************* Error messages *********************************************************************************/
@@ -60,6 +63,19 @@ static const char* Argon2_ErrorMessage[] = {
     [ARGON2_INCORRECT_TYPE] = "There is no such version of Argon2",
 
     [ARGON2_OUT_PTR_MISMATCH] = "Output pointer mismatch",
+
+    [ARGON2_IMPL_NOT_SUPPORTED] = "The implementation is not supported on this CPU",
+
+    [ARGON2_ARENA_TOO_SMALL] = "The arena is too small for the memory cost",
+
+    [ARGON2_QUEUE_FULL] = "The worker pool has its limit of submitted contexts",
+
+    [ARGON2_VERIFY_MISMATCH] = "The tag does not match",
+
+    [ARGON2_ENCODING_FAIL] = "The buffer is too small for the encoded hash",
+    [ARGON2_DECODING_FAIL] = "The encoded hash is malformed",
+
+    [ARGON2_ARENA_BUSY] = "The arena is used by another call",
 };
 
 int PHS(void *out, size_t outlen, const void *in, size_t inlen, const void *salt, size_t saltlen, unsigned int t_cost, unsigned int m_cost) {
@@ -106,6 +122,222 @@ int Argon2ds(Argon2_Context* context) {
     return Argon2Core(context, Argon2_ds);
 }
 
+/*
+ * Argon2 batch data: the contexts hashed in parallel, one job per context
+ */
+typedef struct Argon2_batch_data_t Argon2_batch_data_t;
+struct Argon2_batch_data_t {
+    Argon2_Context** contexts;
+    enum Argon2_type type;
+    int* results;
+};
+
+static void HashBatchJob(void* batch_data, uint32_t index) {
+    Argon2_batch_data_t* my_data = (Argon2_batch_data_t*) batch_data;
+    my_data->results[index] = Argon2Core(my_data->contexts[index], my_data->type);
+}
+
+int Argon2_HashBatch(Argon2_Context** contexts, uint32_t count, enum Argon2_type type, int* results, Argon2_ThreadPool* pool) {
+    if (NULL == contexts || NULL == results) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+
+    Argon2_batch_data_t batch_data = {contexts, type, results};
+    if (NULL != pool) {
+        RunInParallel(pool, HashBatchJob, &batch_data, count);
+    } else {
+        for (uint32_t i = 0; i < count; ++i) {
+            HashBatchJob(&batch_data, i);
+        }
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (ARGON2_OK != results[i]) {
+            return results[i];
+        }
+    }
+    return ARGON2_OK;
+}
+
+/*
+ * Argon2 submission: a context hashed by a worker, then reported to the callback
+ */
+typedef struct Argon2_submit_data_t Argon2_submit_data_t;
+struct Argon2_submit_data_t {
+    Argon2_Context* context;
+    enum Argon2_type type;
+    Argon2_CompletionCallback callback;
+    void* user_data;
+};
+
+static void SubmitContextJob(void* submit_data, uint32_t index) {
+    Argon2_submit_data_t* my_data = (Argon2_submit_data_t*) submit_data;
+    (void) index;
+    int result = Argon2Core(my_data->context, my_data->type);
+    if (NULL != my_data->callback) {
+        my_data->callback(my_data->context, result, my_data->user_data);
+    }
+    free(my_data);
+}
+
+int Argon2_Submit(Argon2_ThreadPool* pool, Argon2_Context* context, enum Argon2_type type, Argon2_CompletionCallback callback, void* user_data) {
+    Argon2_submit_data_t* submit_data = malloc(sizeof (Argon2_submit_data_t));
+    if (NULL == submit_data) {
+        return ARGON2_MEMORY_ALLOCATION_ERROR;
+    }
+    submit_data->context = context;
+    submit_data->type = type;
+    submit_data->callback = callback;
+    submit_data->user_data = user_data;
+
+    if (NULL == pool) {
+        SubmitContextJob(submit_data, 0);
+        return ARGON2_OK;
+    }
+    int result = SubmitJob(pool, SubmitContextJob, submit_data);
+    if (ARGON2_OK != result) {
+        free(submit_data);
+    }
+    return result;
+}
+
+/* Compares two buffers in a time that depends only on their length */
+static bool ConstantTimeEqual(const uint8_t* a, const uint8_t* b, size_t length) {
+    volatile uint8_t difference = 0;
+    for (size_t i = 0; i < length; ++i) {
+        difference |= a[i] ^ b[i];
+    }
+    return 0 == difference;
+}
+
+/* Checks the cost parameters of a context against those accepted by a policy */
+static int ValidatePolicy(const Argon2_Context* context, const Argon2_Policy* policy) {
+    if (NULL == policy) {
+        return ARGON2_OK;
+    }
+    if (0 != policy->max_t_cost && policy->max_t_cost < context->t_cost) {
+        return ARGON2_TIME_TOO_LARGE;
+    }
+    if (0 != policy->max_m_cost && policy->max_m_cost < context->m_cost) {
+        return ARGON2_MEMORY_TOO_MUCH;
+    }
+    if (0 != policy->max_lanes && policy->max_lanes < context->lanes) {
+        return ARGON2_LANES_TOO_MANY;
+    }
+    return ARGON2_OK;
+}
+
+int Argon2_Verify(Argon2_Context* context, enum Argon2_type type, const uint8_t* tag, const Argon2_Policy* policy) {
+    if (NULL == tag) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+    // Reject before allocating anything
+    int result = ValidateInputs(context);
+    if (ARGON2_OK != result) {
+        return result;
+    }
+    result = ValidatePolicy(context, policy);
+    if (ARGON2_OK != result) {
+        return result;
+    }
+
+    result = Argon2Core(context, type);
+    if (ARGON2_OK != result) {
+        return result;
+    }
+    bool match = ConstantTimeEqual(context->out, tag, context->outlen);
+    secure_wipe_memory(context->out, context->outlen);
+    return match ? ARGON2_OK : ARGON2_VERIFY_MISMATCH;
+}
+
+/*
+ * Argon2 incremental state: the instance being filled and the next slice to fill
+ */
+struct Argon2_State {
+    Argon2_Context* context;
+    Argon2_instance_t instance;
+    uint32_t pass; //Pass of the next slice
+    uint8_t slice; //Next slice in the pass
+};
+
+static uint64_t SlicesLeft(const Argon2_State* state) {
+    return (uint64_t) (state->instance.passes - state->pass) * SYNC_POINTS - state->slice;
+}
+
+int Argon2_Init(Argon2_State** state, Argon2_Context* context, enum Argon2_type type) {
+    if (NULL == state) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+    *state = NULL;
+
+    int result = ValidateInputs(context);
+    if (ARGON2_OK != result) {
+        return result;
+    }
+    if (type >= MAX_ARGON2_TYPE) {
+        return ARGON2_INCORRECT_TYPE;
+    }
+
+    Argon2_State* new_state = malloc(sizeof (Argon2_State));
+    if (NULL == new_state) {
+        return ARGON2_MEMORY_ALLOCATION_ERROR;
+    }
+    // The instance has constant members, so it is copied rather than assigned
+    Argon2_instance_t instance = NewInstance(context, type);
+    memcpy(&new_state->instance, &instance, sizeof (Argon2_instance_t));
+    new_state->context = context;
+    new_state->pass = 0;
+    new_state->slice = 0;
+
+    result = Initialize(&new_state->instance, context);
+    if (ARGON2_OK != result) {
+        free(new_state);
+        return result;
+    }
+    *state = new_state;
+    return ARGON2_OK;
+}
+
+uint64_t Argon2_Step(Argon2_State* state, uint64_t slices) {
+    if (NULL == state) {
+        return 0;
+    }
+    for (; slices > 0 && state->pass < state->instance.passes; --slices) {
+        FillSlice(&state->instance, state->pass, state->slice);
+        if (++state->slice == SYNC_POINTS) {
+            state->slice = 0;
+            ++state->pass;
+        }
+    }
+    return SlicesLeft(state);
+}
+
+int Argon2_Final(Argon2_State* state) {
+    if (NULL == state) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+    Argon2_Step(state, SlicesLeft(state));
+    Finalize(state->context, &state->instance);
+    free(state);
+    return ARGON2_OK;
+}
+
+void Argon2_Abort(Argon2_State* state) {
+    if (NULL == state) {
+        return;
+    }
+    ReleaseMemory(state->context, &state->instance);
+    free(state);
+}
+
+int Argon2_SelectImpl(enum Argon2_impl impl) {
+    return SelectCore(impl);
+}
+
+const char* Argon2_ImplName(void) {
+    return CurrentCore()->name;
+}
+
 const char* ErrorMessage(int error_code) {
     if (error_code < ARGON2_ERROR_CODES_LENGTH) {
         return Argon2_ErrorMessage[error_code];
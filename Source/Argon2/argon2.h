@@ -109,15 +109,121 @@ enum Argon2_ErrorCodes {
 
     ARGON2_OUT_PTR_MISMATCH = 27,
 
+    ARGON2_IMPL_NOT_SUPPORTED = 28,
+
+    ARGON2_ARENA_TOO_SMALL = 29,
+
+    ARGON2_QUEUE_FULL = 30,
+
+    ARGON2_VERIFY_MISMATCH = 31,
+
+    ARGON2_ENCODING_FAIL = 32,
+    ARGON2_DECODING_FAIL = 33,
+
+    ARGON2_ARENA_BUSY = 34,
+
     ARGON2_ERROR_CODES_LENGTH /* Do NOT remove; Do NOT add error codes after this error code */
 };
 
 
 
+/********************************************* Argon2 primitive type *************************************************************/
+enum Argon2_type {
+    Argon2_d=0,
+    Argon2_i=1,
+    Argon2_di=2,
+    Argon2_id=3,
+    Argon2_ds=4,
+    MAX_ARGON2_TYPE /* Do NOT remove; Do NOT other types after this one */
+};
+
+/********************************************* Argon2 implementations *************************************************************/
+enum Argon2_impl {
+    ARGON2_IMPL_AUTO=0, /* Fastest one supported by the CPU */
+    ARGON2_IMPL_REF=1,
+    ARGON2_IMPL_SSE=2,
+    ARGON2_IMPL_AVX2=3,
+    ARGON2_IMPL_AVX512=4,
+    ARGON2_IMPL_NEON=5,
+    MAX_ARGON2_IMPL /* Do NOT remove; Do NOT add implementations after this one */
+};
+
 /********************************************* Memory allocator types --- for external allocation *************************************************************/
 typedef int (*AllocateMemoryCallback)(uint8_t **memory, size_t bytes_to_allocate);
 typedef void(*FreeMemoryCallback)(uint8_t *memory, size_t bytes_to_allocate);
 
+/*
+ * Built-in allocator for large memory costs, to be set as allocate_cbk together with Argon2_FreeHugePages as free_cbk.
+ * The memory is backed by huge pages when possible: explicit ones (MAP_HUGETLB), then transparent ones (MADV_HUGEPAGE,
+ * with the mapping aligned to 2 MiB), then regular pages; on systems without mmap it falls back to malloc.
+ * The pages are not placed on any particular NUMA node: the workers of a pool take up segments in any order
+ * @param  memory  Pointer to the pointer to the memory
+ * @param  bytes_to_allocate  Size in bytes, rounded up to 2 MiB
+ * @return  ARGON2_OK if successful, ARGON2_MEMORY_ALLOCATION_ERROR otherwise
+ */
+int Argon2_AllocateHugePages(uint8_t **memory, size_t bytes_to_allocate);
+
+/*
+ * Releases memory obtained from Argon2_AllocateHugePages
+ * @param  memory  Pointer to the memory
+ * @param  bytes_to_allocate  The size passed to Argon2_AllocateHugePages
+ */
+void Argon2_FreeHugePages(uint8_t *memory, size_t bytes_to_allocate);
+
+/*
+ * Sets the storage backing Argon2_AllocateMappedFile, for memory costs beyond the RAM budget. Not thread-safe: call it before hashing
+ * @param  path  Directory, in which every allocation creates its own unlinked file, or file (created if needed, empty otherwise:
+ * a file with content is refused, and the file is emptied again when freed) or block device, used by one allocation at a time:
+ * an allocation while the file or device is in use fails; NULL to unset it
+ * @return  ARGON2_OK if successful, ARGON2_INCORRECT_PARAMETER if the path is too long or mmap is not available
+ */
+int Argon2_SetMappedFile(const char* path);
+
+/*
+ * Allocator mapping the memory onto the storage set by Argon2_SetMappedFile, to be set as allocate_cbk together with
+ * Argon2_FreeMappedFile as free_cbk. The kernel pages the blocks in and out, so only the working set needs to fit in RAM;
+ * read-ahead is disabled as the reference blocks are read at random. The lanes are contiguous in the file
+ * @param  memory  Pointer to the pointer to the memory
+ * @param  bytes_to_allocate  Size in bytes; the file is extended to it, a device must be at least as large
+ * @return  ARGON2_OK if successful, ARGON2_MEMORY_ALLOCATION_ERROR otherwise (no storage set, or it cannot be mapped)
+ */
+int Argon2_AllocateMappedFile(uint8_t **memory, size_t bytes_to_allocate);
+
+/*
+ * Unmaps memory obtained from Argon2_AllocateMappedFile; a file created in a directory is deleted, and the file set is emptied.
+ * As for any free_cbk, the memory has been wiped before if clear_memory is set
+ * @param  memory  Pointer to the memory
+ * @param  bytes_to_allocate  The size passed to Argon2_AllocateMappedFile
+ */
+void Argon2_FreeMappedFile(uint8_t *memory, size_t bytes_to_allocate);
+
+/********************************************* Worker pool type --- for threads shared between calls *************************************************************/
+typedef struct Argon2_ThreadPool Argon2_ThreadPool;
+
+/********************************************* Memory arena type --- for memory reused between calls *************************************************************/
+typedef struct Argon2_Arena Argon2_Arena;
+
+/********************************************* Timing statistics --- for finding where the time of a call goes *************************************************************/
+/*
+ * Per-phase wall-clock times of a call in nanoseconds, filled only if the library is built with ARGON2_STATS (make STATS=TRUE),
+ * otherwise left untouched. The call resets all of them, including the arrays, during its initialization
+ */
+typedef struct Argon2_Stats Argon2_Stats;
+struct Argon2_Stats {
+    uint64_t allocate_ns; //allocating the memory (and the S-boxes of Argon2ds)
+    uint64_t initial_hash_ns; //hashing the inputs
+    uint64_t first_blocks_ns; //filling the first two blocks of each lane
+    uint64_t fill_ns; //filling all passes, S-box generation included
+    uint64_t sbox_ns; //generating the S-boxes of Argon2ds, partly overlapped with filling
+    uint64_t finalize_ns; //XORing the last blocks and hashing them
+    uint64_t release_ns; //wiping (if requested) and deallocating the memory
+    uint64_t* pass_ns; //array of t_cost filling times, one per pass, can be NULL
+    uint64_t* segment_ns; //array of t_cost * SYNC_POINTS * lanes segment times, index (pass * SYNC_POINTS + slice) * lanes + lane, can be NULL
+};
+
+/********************************************* Incremental hashing state --- for computations split into steps *************************************************************/
+typedef struct Argon2_State Argon2_State;
+
 /********************************************* Argon2 external data structures*************************************************************/
 
 /*
@@ -132,6 +238,10 @@ typedef void(*FreeMemoryCallback)(uint8_t *memory, size_t bytes_to_allocate);
  * All the parameters above affect the output hash value.
  * Additionally, two function pointers can be provided to allocate and deallocate the memory (if NULL, memory will be allocated internally).
  * Also, three flags indicate whether to erase password, secret as soon as they are pre-hashed (and thus not needed anymore), and the entire memory
+ * Finally, a worker pool can be provided to fill the lanes (if NULL, threads are created for every slice),
+ * an arena can provide the memory (if NULL, it is allocated and deallocated by the call),
+ * statistics can receive the time spent in each phase (if the library is built with ARGON2_STATS),
+ * and the memory can be cleared by the worker pool after the call returns (the arena waits for it before being reused).
  ****************************
  Simplest situation: you have output array out[8], password is stored in pwd[32], salt is stored in salt[16], you do not have keys nor associated data.
  You need to spend 1 GB of RAM and you run 5 passes of Argon2d with 4 parallel lanes.
@@ -166,9 +276,45 @@ struct Argon2_Context {
 
     const bool clear_password; //whether to clear the password array
     const bool clear_secret; //whether to clear the secret array
-    const bool clear_memory; //whether to clear the memory after the run
+    const bool clear_memory; //whether to clear the memory after the run, before free_cbk if set
+
+    Argon2_ThreadPool *thread_pool; //pointer to worker pool
+    Argon2_Arena *arena; //pointer to memory arena
+
+    Argon2_Stats *stats; //pointer to timing statistics, can be NULL
+
+    bool defer_wipe; //whether a worker of thread_pool clears and releases the memory after the call returns, ignored with free_cbk unless arena is set
+};
+
+/*
+ *****Params: cost parameters picked by Argon2_Tune()
+ */
+typedef struct Argon2_Params Argon2_Params;
+struct Argon2_Params {
+    uint32_t t_cost; //number of passes
+    uint32_t m_cost; //amount of memory (KB)
+    uint32_t lanes; //number of parallel threads
+    double milliseconds; //measured duration of a hash with these parameters
 };
 
+/*
+ *****Policy: cost parameters accepted by Argon2_Verify(), within the limits of the library; 0 means no further limit
+ */
+typedef struct Argon2_Policy Argon2_Policy;
+struct Argon2_Policy {
+    uint32_t max_t_cost; //largest number of passes
+    uint32_t max_m_cost; //largest amount of memory (KB)
+    uint32_t max_lanes; //largest number of parallel threads
+};
+
+/*
+ * Called by a worker when a context submitted by Argon2_Submit() is hashed, after the output is written and the memory released
+ * @param  context  The submitted context
+ * @param  result  Error code of the hash, as returned by the Argon2 modes
+ * @param  user_data  Pointer given to Argon2_Submit()
+ */
+typedef void (*Argon2_CompletionCallback)(Argon2_Context* context, int result, void* user_data);
+
 /**
  * Function to hash the inputs in the memory-hard fashion
  * @param  out  Pointer to the memory where the hash digest will be written
@@ -224,6 +370,187 @@ extern int Argon2ds(Argon2_Context* context);
  */
 extern int Argon2id(Argon2_Context* context);
 
+/*
+ * Creates a pool of worker threads that can be shared by any number of Argon2 calls, also concurrent ones.
+ * The thread calling Argon2 takes part in the work, so @a threads = lanes - 1 is enough to run all lanes in parallel
+ * @param  threads  Number of worker threads
+ * @param  pin_threads  Whether to pin worker i to CPU i (only on Linux, ignored elsewhere)
+ * @return  Pointer to the pool, NULL if the threads could not be created
+ */
+Argon2_ThreadPool* Argon2_ThreadPoolCreate(uint32_t threads, bool pin_threads);
+
+/*
+ * Stops the workers and deallocates the pool
+ * @param  pool  Pointer to the pool
+ * @pre    No Argon2 call may be using the pool
+ */
+void Argon2_ThreadPoolDestroy(Argon2_ThreadPool* pool);
+
+/*
+ * Bounds the number of contexts submitted to the pool by Argon2_Submit() and not completed yet, which bounds the memory they use.
+ * Deferred wipes (defer_wipe) are not counted: they are queued ahead of the contexts
+ * @param  pool  Pointer to the pool
+ * @param  limit  Maximum number of contexts, 0 for no limit (the default)
+ */
+void Argon2_ThreadPoolSetQueueLimit(Argon2_ThreadPool* pool, uint32_t limit);
+
+/*
+ * Creates an arena: memory for the blocks and the S-box, allocated with Argon2_AllocateHugePages and faulted in once by the calling thread,
+ * then reused by every call whose context points to it. The memory is wiped after a call only if its clear_memory is set.
+ * The arena serves one hash at a time: a call (or Argon2_Init() until Argon2_Final() or Argon2_Abort()) started while
+ * another one holds it fails with ARGON2_ARENA_BUSY, so concurrent hashes, e.g. in Argon2_HashBatch(), need their own arenas
+ * @param  m_cost  Largest memory cost (KB) of the calls using the arena
+ * @param  lanes  Largest number of lanes of the calls using the arena
+ * @return  Pointer to the arena, NULL if the memory could not be allocated
+ */
+Argon2_Arena* Argon2_ArenaCreate(uint32_t m_cost, uint32_t lanes);
+
+/*
+ * Wipes and deallocates the arena
+ * @param  arena  Pointer to the arena
+ * @pre    No Argon2 call may be using the arena
+ */
+void Argon2_ArenaDestroy(Argon2_Arena* arena);
+
+/*
+ * Hashes many independent contexts with the same Argon2 type. The contexts are handed out one at a time to whichever
+ * thread of @a pool is idle, so the throughput scales with the number of workers even if each context has a single lane.
+ * Each context is processed as by the corresponding Argon2 mode and may use its own thread_pool (possibly @a pool) for its lanes
+ * @param  contexts  Array of @a count pointers to contexts
+ * @param  count  Number of contexts
+ * @param  type  Argon2 type
+ * @param  results  Array of @a count error codes, one per context
+ * @param  pool  Worker pool; if NULL the contexts are hashed one after another in the calling thread
+ * @return  ARGON2_OK if all contexts were hashed, otherwise the error code of the first context that failed
+ */
+int Argon2_HashBatch(Argon2_Context** contexts, uint32_t count, enum Argon2_type type, int* results, Argon2_ThreadPool* pool);
+
+/*
+ * Queues a context to be hashed by a worker of @a pool and returns at once; @a callback is then called by that worker
+ * (it can e.g. write to an eventfd or a pipe watched by an event loop). The context and its buffers must stay valid until the callback.
+ * The context may use its own thread_pool (possibly @a pool) for its lanes.
+ * If the pool has its queue limit of uncompleted contexts (see Argon2_ThreadPoolSetQueueLimit()), nothing is queued and ARGON2_QUEUE_FULL
+ * is returned, so that the caller can retry later
+ * @param  pool  Worker pool; if NULL the context is hashed in the calling thread and @a callback is called before returning
+ * @param  context  Pointer to the context
+ * @param  type  Argon2 type
+ * @param  callback  Function called when the context is hashed, can be NULL
+ * @param  user_data  Pointer passed to @a callback
+ * @return  ARGON2_OK if the context is queued, ARGON2_QUEUE_FULL or ARGON2_MEMORY_ALLOCATION_ERROR if not (then @a callback is not called)
+ */
+int Argon2_Submit(Argon2_ThreadPool* pool, Argon2_Context* context, enum Argon2_type type, Argon2_CompletionCallback callback, void* user_data);
+
+/*
+ * Starts an incremental computation, continued by Argon2_Step() and completed by Argon2_Final() or cancelled by Argon2_Abort().
+ * Validates the inputs, allocates the memory and fills the first blocks; the output is the same as the one of the Argon2 mode @a type.
+ * The password and secret are cleared here if requested. The context, with its worker pool and arena if any, is used until the computation ends
+ * @param  state  Pointer to the pointer receiving the state
+ * @param  context  Pointer to current Argon2 context
+ * @param  type  Argon2 type
+ * @return  ARGON2_OK if successful, otherwise an error code and no state is created
+ */
+int Argon2_Init(Argon2_State** state, Argon2_Context* context, enum Argon2_type type);
+
+/*
+ * Fills the next slices of the memory. A pass has SYNC_POINTS slices of m_cost / SYNC_POINTS blocks each,
+ * so bounding @a slices bounds the time spent in the call; the computation resumes from the next slice at the following call
+ * @param  state  State created by Argon2_Init()
+ * @param  slices  Maximum number of slices to fill
+ * @return  Number of slices left, 0 when the memory is filled
+ */
+uint64_t Argon2_Step(Argon2_State* state, uint64_t slices);
+
+/*
+ * Fills the slices left, if any, writes the output to the context and deallocates the memory (or keeps it in the arena) and the state
+ * @param  state  State created by Argon2_Init()
+ * @return  ARGON2_OK if successful, ARGON2_INCORRECT_PARAMETER if @a state is NULL
+ */
+int Argon2_Final(Argon2_State* state);
+
+/*
+ * Cancels the computation: deallocates the memory (wiped if clear_memory is set, or kept in the arena) and the state without writing the output
+ * @param  state  State created by Argon2_Init(), can be NULL
+ */
+void Argon2_Abort(Argon2_State* state);
+
+/*
+ * Recomputes the tag of a context and compares it with @a tag in constant time. The parameters are checked against the library
+ * limits and @a policy before any memory is allocated, so out-of-policy requests cost nothing. The context is processed as by
+ * the Argon2 mode @a type (with its worker pool and arena, if any); its output buffer receives the computed tag and is cleared afterwards
+ * @param  context  Pointer to the context, out must hold outlen bytes
+ * @param  type  Argon2 type
+ * @param  tag  Expected tag of outlen bytes
+ * @param  policy  Pointer to the accepted cost parameters, can be NULL
+ * @return  ARGON2_OK if the tags match, ARGON2_VERIFY_MISMATCH if they do not, ARGON2_TIME_TOO_LARGE, ARGON2_MEMORY_TOO_MUCH
+ * or ARGON2_LANES_TOO_MANY if the parameters are out of policy, another error code if the context is invalid
+ */
+int Argon2_Verify(Argon2_Context* context, enum Argon2_type type, const uint8_t* tag, const Argon2_Policy* policy);
+
+/*
+ * Returns the size of the buffer Argon2_Encode() needs for a context, the terminating NUL included
+ * @param  context  Pointer to the context, whose cost parameters, salt length and output length are encoded
+ * @param  type  Argon2 type
+ * @return  Number of bytes, 0 if the context is NULL or the type unknown
+ */
+size_t Argon2_EncodedLength(const Argon2_Context* context, enum Argon2_type type);
+
+/*
+ * Writes the hash of a context as the string $argon2<type>$v=<version>$m=<m_cost>,t=<t_cost>,p=<lanes>$<salt>$<tag>,
+ * with the salt and the output (the tag) in base64 without padding. Nothing is allocated
+ * @param  encoded  Buffer receiving the NUL-terminated string
+ * @param  encodedlen  Size of the buffer, at least Argon2_EncodedLength()
+ * @param  context  Pointer to the context, hashed already
+ * @param  type  Argon2 type of the hash
+ * @return  ARGON2_OK if successful, ARGON2_ENCODING_FAIL if the buffer is too small, another error code if the inputs are invalid
+ */
+int Argon2_Encode(char* encoded, size_t encodedlen, const Argon2_Context* context, enum Argon2_type type);
+
+/*
+ * Parses a string written by Argon2_Encode() into a context ready for Argon2_Verify(). The salt and the tag are decoded in place,
+ * so the string is overwritten and must outlive the context; nothing is allocated. The cost parameters, the salt and the output length
+ * (the tag length) are set from the string, the other members of the context (output buffer, password, secret, ...) are kept
+ * @param  encoded  NUL-terminated string, overwritten
+ * @param  context  Pointer to the context: on input, out is the output buffer, which must not overlap @a encoded, and outlen its size
+ * @param  type  Pointer receiving the Argon2 type
+ * @param  tag  Pointer receiving the pointer to the tag, in @a encoded
+ * @return  ARGON2_OK if successful, ARGON2_DECODING_FAIL if the string is malformed or of another version, if its tag is longer than outlen
+ * or if out overlaps the string, ARGON2_INCORRECT_PARAMETER if a pointer is NULL
+ */
+int Argon2_Decode(char* encoded, Argon2_Context* context, enum Argon2_type* type, const uint8_t** tag);
+
+/*
+ * Picks the strongest cost parameters that hash within a latency budget on this host, by timing Argon2 calls with the selected
+ * implementation and @a pool, memory allocation and wipe included. Memory comes first: m_cost is the largest amount up to @a max_m_cost
+ * that the fewest passes fill within the budget, then t_cost is the number of passes that still fits. The fewest passes are 3 for
+ * Argon2i, Argon2di and Argon2id, whose password-independent addressing tradeoff attacks break with fewer, and 1 otherwise.
+ * @a lanes is not tuned: it is the parallelism the caller grants each hash, usually the workers of @a pool plus the calling thread,
+ * which the timing cannot see when several hashes run at once; it is returned unchanged in @a params->lanes.
+ * If even the smallest memory does not fit, the smallest parameters are returned and @a params->milliseconds exceeds the budget.
+ * Takes a few times @a target_ms to run
+ * @param  type  Argon2 type
+ * @param  target_ms  Latency budget of one hash in milliseconds
+ * @param  max_m_cost  Largest amount of memory (KB)
+ * @param  lanes  Number of lanes
+ * @param  pool  Worker pool used by the hashes, can be NULL
+ * @param  params  Pointer receiving the parameters
+ * @return  ARGON2_OK if successful, an error code otherwise
+ */
+int Argon2_Tune(enum Argon2_type type, uint32_t target_ms, uint32_t max_m_cost, uint32_t lanes, Argon2_ThreadPool* pool, Argon2_Params* params);
+
+/*
+ * Selects the implementation used by all following Argon2 calls. The outputs do not depend on it.
+ * By default the fastest implementation supported by the CPU is used
+ * @param  impl  Implementation, ARGON2_IMPL_AUTO to restore the default
+ * @return  ARGON2_OK if successful, ARGON2_IMPL_NOT_SUPPORTED if the implementation is not built or not supported by the CPU
+ * @pre    No Argon2 call may be running
+ */
+int Argon2_SelectImpl(enum Argon2_impl impl);
+
+/*
+ * Returns the name of the selected implementation: "ref", "sse", "avx2", "avx512" or "neon"
+ */
+const char* Argon2_ImplName(void);
+
 /*
  * Get the associated error message for given errno code
  * @return  The error message associated with the given error code
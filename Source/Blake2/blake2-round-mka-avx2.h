@@ -0,0 +1,62 @@
+#pragma once
+
+#ifndef __BLAKE2_ROUND_MKA_AVX2_H__
+#define __BLAKE2_ROUND_MKA_AVX2_H__
+
+/* Argon2 Team - Begin Code */
+/*
+ * BLAKE2 rounds with the BlaMka multiplication on four 64-bit words per register (AVX2).
+ * A row of 16 words v0..v15 is held as A = (v0..v3), B = (v4..v7), C = (v8..v11), D = (v12..v15),
+ * so the four column steps of a round run in parallel and the diagonal steps need a rotation of B, C and D.
+ * The macros expect __m256i r16 and r24 shuffle masks in scope and must be used in functions compiled for AVX2.
+ */
+
+#define _mm256_roti_epi64(x, c) \
+	(-(c) == 32) ? _mm256_shuffle_epi32((x), _MM_SHUFFLE(2,3,0,1))  \
+	: (-(c) == 24) ? _mm256_shuffle_epi8((x), r24) \
+	: (-(c) == 16) ? _mm256_shuffle_epi8((x), r16) \
+	: (-(c) == 63) ? _mm256_xor_si256(_mm256_srli_epi64((x), -(c)), _mm256_add_epi64((x), (x)))  \
+	: _mm256_xor_si256(_mm256_srli_epi64((x), -(c)), _mm256_slli_epi64((x), 64-(-(c))))
+
+#define fBlaMka_AVX2(x, y) \
+	_mm256_add_epi64(_mm256_add_epi64((x), (y)), _mm256_slli_epi64(_mm256_mul_epu32((x), (y)), 1))
+
+#define G1_AVX2(A,B,C,D) \
+	A = fBlaMka_AVX2(A, B); \
+	D = _mm256_xor_si256(D, A); \
+	D = _mm256_roti_epi64(D, -32); \
+	C = fBlaMka_AVX2(C, D); \
+	B = _mm256_xor_si256(B, C); \
+	B = _mm256_roti_epi64(B, -24);
+
+#define G2_AVX2(A,B,C,D) \
+	A = fBlaMka_AVX2(A, B); \
+	D = _mm256_xor_si256(D, A); \
+	D = _mm256_roti_epi64(D, -16); \
+	C = fBlaMka_AVX2(C, D); \
+	B = _mm256_xor_si256(B, C); \
+	B = _mm256_roti_epi64(B, -63);
+
+#define DIAGONALIZE_AVX2(A,B,C,D) \
+	B = _mm256_permute4x64_epi64(B, _MM_SHUFFLE(0,3,2,1)); \
+	C = _mm256_permute4x64_epi64(C, _MM_SHUFFLE(1,0,3,2)); \
+	D = _mm256_permute4x64_epi64(D, _MM_SHUFFLE(2,1,0,3));
+
+#define UNDIAGONALIZE_AVX2(A,B,C,D) \
+	B = _mm256_permute4x64_epi64(B, _MM_SHUFFLE(2,1,0,3)); \
+	C = _mm256_permute4x64_epi64(C, _MM_SHUFFLE(1,0,3,2)); \
+	D = _mm256_permute4x64_epi64(D, _MM_SHUFFLE(0,3,2,1));
+
+#define BLAKE2_ROUND_AVX2(A,B,C,D) \
+	G1_AVX2(A,B,C,D); \
+	G2_AVX2(A,B,C,D); \
+	\
+	DIAGONALIZE_AVX2(A,B,C,D); \
+	\
+	G1_AVX2(A,B,C,D); \
+	G2_AVX2(A,B,C,D); \
+	\
+	UNDIAGONALIZE_AVX2(A,B,C,D);
+/* Argon2 Team - End Code */
+
+#endif
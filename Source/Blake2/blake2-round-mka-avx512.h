@@ -0,0 +1,56 @@
+#pragma once
+
+#ifndef __BLAKE2_ROUND_MKA_AVX512_H__
+#define __BLAKE2_ROUND_MKA_AVX512_H__
+
+/* Argon2 Team - Begin Code */
+/*
+ * BLAKE2 rounds with the BlaMka multiplication on eight 64-bit words per register (AVX-512F).
+ * Each register holds the same quarter (A, B, C or D, see blake2-round-mka-avx2.h) of two independent rows,
+ * one per 256-bit half, so one round macro processes two BLAKE2 rounds. Rotations use vprorq.
+ * The macros must be used in functions compiled for AVX-512F.
+ */
+
+#define fBlaMka_AVX512(x, y) \
+	_mm512_add_epi64(_mm512_add_epi64((x), (y)), _mm512_slli_epi64(_mm512_mul_epu32((x), (y)), 1))
+
+#define G1_AVX512(A,B,C,D) \
+	A = fBlaMka_AVX512(A, B); \
+	D = _mm512_xor_si512(D, A); \
+	D = _mm512_ror_epi64(D, 32); \
+	C = fBlaMka_AVX512(C, D); \
+	B = _mm512_xor_si512(B, C); \
+	B = _mm512_ror_epi64(B, 24);
+
+#define G2_AVX512(A,B,C,D) \
+	A = fBlaMka_AVX512(A, B); \
+	D = _mm512_xor_si512(D, A); \
+	D = _mm512_ror_epi64(D, 16); \
+	C = fBlaMka_AVX512(C, D); \
+	B = _mm512_xor_si512(B, C); \
+	B = _mm512_ror_epi64(B, 63);
+
+/* vpermq with an immediate permutes within each 256-bit half, i.e. within each row */
+#define DIAGONALIZE_AVX512(A,B,C,D) \
+	B = _mm512_permutex_epi64(B, _MM_SHUFFLE(0,3,2,1)); \
+	C = _mm512_permutex_epi64(C, _MM_SHUFFLE(1,0,3,2)); \
+	D = _mm512_permutex_epi64(D, _MM_SHUFFLE(2,1,0,3));
+
+#define UNDIAGONALIZE_AVX512(A,B,C,D) \
+	B = _mm512_permutex_epi64(B, _MM_SHUFFLE(2,1,0,3)); \
+	C = _mm512_permutex_epi64(C, _MM_SHUFFLE(1,0,3,2)); \
+	D = _mm512_permutex_epi64(D, _MM_SHUFFLE(0,3,2,1));
+
+#define BLAKE2_ROUND_AVX512(A,B,C,D) \
+	G1_AVX512(A,B,C,D); \
+	G2_AVX512(A,B,C,D); \
+	\
+	DIAGONALIZE_AVX512(A,B,C,D); \
+	\
+	G1_AVX512(A,B,C,D); \
+	G2_AVX512(A,B,C,D); \
+	\
+	UNDIAGONALIZE_AVX512(A,B,C,D);
+/* Argon2 Team - End Code */
+
+#endif
@@ -0,0 +1,106 @@
+#pragma once
+
+#ifndef __BLAKE2_ROUND_MKA_NEON_H__
+#define __BLAKE2_ROUND_MKA_NEON_H__
+
+/* Argon2 Team - Begin Code */
+/*
+ * NEON version of blake2-round-mka.h: the same rows of two 128-bit registers, with uint64x2_t
+ */
+#define BLAKE2_ROTR64_NEON(x, c) \
+	(((c) == 32) ? vreinterpretq_u64_u32(vrev64q_u32(vreinterpretq_u32_u64(x))) \
+	: vsriq_n_u64(vshlq_n_u64((x), 64 - (c)), (x), (c)))
+
+static inline uint64x2_t fBlaMkaNEON(uint64x2_t x, uint64x2_t y) {
+    uint64x2_t z = vmull_u32(vmovn_u64(x), vmovn_u64(y));
+
+    z = vshlq_n_u64(z, 1);
+
+    z = vaddq_u64(z, x);
+    z = vaddq_u64(z, y);
+
+    return z;
+}
+
+#define G1_NEON(row1l,row2l,row3l,row4l,row1h,row2h,row3h,row4h) \
+	row1l = fBlaMkaNEON(row1l, row2l); \
+	row1h = fBlaMkaNEON(row1h, row2h); \
+	\
+	row4l = veorq_u64(row4l, row1l); \
+	row4h = veorq_u64(row4h, row1h); \
+	\
+	row4l = BLAKE2_ROTR64_NEON(row4l, 32); \
+	row4h = BLAKE2_ROTR64_NEON(row4h, 32); \
+	\
+	row3l = fBlaMkaNEON(row3l, row4l); \
+	row3h = fBlaMkaNEON(row3h, row4h); \
+	\
+	row2l = veorq_u64(row2l, row3l); \
+	row2h = veorq_u64(row2h, row3h); \
+	\
+	row2l = BLAKE2_ROTR64_NEON(row2l, 24); \
+	row2h = BLAKE2_ROTR64_NEON(row2h, 24);
+
+#define G2_NEON(row1l,row2l,row3l,row4l,row1h,row2h,row3h,row4h) \
+	row1l = fBlaMkaNEON(row1l, row2l); \
+	row1h = fBlaMkaNEON(row1h, row2h); \
+	\
+	row4l = veorq_u64(row4l, row1l); \
+	row4h = veorq_u64(row4h, row1h); \
+	\
+	row4l = BLAKE2_ROTR64_NEON(row4l, 16); \
+	row4h = BLAKE2_ROTR64_NEON(row4h, 16); \
+	\
+	row3l = fBlaMkaNEON(row3l, row4l); \
+	row3h = fBlaMkaNEON(row3h, row4h); \
+	\
+	row2l = veorq_u64(row2l, row3l); \
+	row2h = veorq_u64(row2h, row3h); \
+	\
+	row2l = BLAKE2_ROTR64_NEON(row2l, 63); \
+	row2h = BLAKE2_ROTR64_NEON(row2h, 63);
+
+/* vextq_u64(b, a, 1) is _mm_alignr_epi8(a, b, 8): the high word of b, then the low word of a */
+#define DIAGONALIZE_NEON(row1l,row2l,row3l,row4l,row1h,row2h,row3h,row4h) \
+	t0 = vextq_u64(row2l, row2h, 1); \
+	t1 = vextq_u64(row2h, row2l, 1); \
+	row2l = t0; \
+	row2h = t1; \
+	\
+	t0 = row3l; \
+	row3l = row3h; \
+	row3h = t0; \
+	\
+	t0 = vextq_u64(row4l, row4h, 1); \
+	t1 = vextq_u64(row4h, row4l, 1); \
+	row4l = t1; \
+	row4h = t0;
+
+#define UNDIAGONALIZE_NEON(row1l,row2l,row3l,row4l,row1h,row2h,row3h,row4h) \
+	t0 = vextq_u64(row2h, row2l, 1); \
+	t1 = vextq_u64(row2l, row2h, 1); \
+	row2l = t0; \
+	row2h = t1; \
+	\
+	t0 = row3l; \
+	row3l = row3h; \
+	row3h = t0; \
+	\
+	t0 = vextq_u64(row4h, row4l, 1); \
+	t1 = vextq_u64(row4l, row4h, 1); \
+	row4l = t1; \
+	row4h = t0;
+
+#define BLAKE2_ROUND_NEON(row1l,row1h,row2l,row2h,row3l,row3h,row4l,row4h) \
+	G1_NEON(row1l,row2l,row3l,row4l,row1h,row2h,row3h,row4h); \
+	G2_NEON(row1l,row2l,row3l,row4l,row1h,row2h,row3h,row4h); \
+	\
+	DIAGONALIZE_NEON(row1l,row2l,row3l,row4l,row1h,row2h,row3h,row4h); \
+	\
+	G1_NEON(row1l,row2l,row3l,row4l,row1h,row2h,row3h,row4h); \
+	G2_NEON(row1l,row2l,row3l,row4l,row1h,row2h,row3h,row4h); \
+	\
+	UNDIAGONALIZE_NEON(row1l,row2l,row3l,row4l,row1h,row2h,row3h,row4h);
+/* Argon2 Team - End Code */
+
+#endif
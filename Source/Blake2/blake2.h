@@ -143,6 +143,18 @@ extern "C" {
   int blake2b( uint8_t *out, const void *in, const void *key, const uint8_t outlen, const uint64_t inlen, uint8_t keylen );
   /* Argon2 Team - Begin Code */
   int blake2b_long(uint8_t *out, const void *in, const uint32_t outlen, const uint64_t inlen);
+  // blake2b_long() of n inputs of the same length into n outputs, several at a time with AVX2 or AVX-512F
+  // when the CPU supports them. The width is picked from the CPU features once, by the first hash
+  int blake2b_long_xN(uint8_t **out, const void **in, const uint32_t n, const uint32_t outlen, const uint64_t inlen);
+
+  // Test-only override of the compression function, the portable one by default. Must be called before the first hash,
+  // never while BLAKE2b is in use. Returns 0, or -1 if the function is not built or not supported by the CPU
+  enum blake2b_compress_choice
+  {
+    BLAKE2B_COMPRESS_PORTABLE = 0,
+    BLAKE2B_COMPRESS_SSE41 = 1
+  };
+  int blake2b_select_compress( int choice );
   /* Argon2 Team - End Code */
 
   int blake2sp( uint8_t *out, const void *in, const void *key, const uint8_t outlen, const uint64_t inlen, uint8_t keylen );
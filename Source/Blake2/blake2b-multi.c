@@ -0,0 +1,234 @@
+/*
+ * Argon2 source code package
+ *
+ * This work is licensed under a Creative Commons CC0 1.0 License/Waiver.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+/* Argon2 Team - Begin Code */
+/*
+ * Multi-buffer blake2b_long: W independent inputs of the same length hashed at once, each 64-bit lane of a vector register
+ * holding the same state word of a different input (4 inputs with AVX2, 8 with AVX-512F).
+ * Called through blake2b_long_xN() in blake2b-ref.c, which checks the CPU.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "blake2.h"
+#include "blake2-impl.h"
+
+#if defined(__GNUC__) && (defined(__clang__) || __GNUC__ >= 5) && (defined(__x86_64__) || defined(__i386__))
+
+#include <x86intrin.h>
+
+#include "blake2-round-mka-avx2.h"
+
+static const uint64_t blake2b_IV[8] =
+{
+  0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+  0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+  0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+  0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
+};
+
+static const uint8_t blake2b_sigma[12][16] =
+{
+  {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 } ,
+  { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 } ,
+  { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 } ,
+  {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 } ,
+  {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 } ,
+  {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 } ,
+  { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 } ,
+  { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 } ,
+  {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 } ,
+  { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13 , 0 } ,
+  {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 } ,
+  { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
+};
+
+/*
+ * Copies block @a k of the message @a prefix || @a in into @a block, padded with zeros
+ */
+static void blake2b_multi_load_block( uint8_t block[BLAKE2B_BLOCKBYTES], const uint8_t *prefix, size_t prefixlen,
+                                      const uint8_t *in, size_t inlen, size_t k )
+{
+  size_t offset = k * BLAKE2B_BLOCKBYTES;
+  size_t filled = 0;
+  memset( block, 0, BLAKE2B_BLOCKBYTES );
+  if( offset < prefixlen )
+  {
+    filled = prefixlen - offset < BLAKE2B_BLOCKBYTES ? prefixlen - offset : BLAKE2B_BLOCKBYTES;
+    memcpy( block, prefix + offset, filled );
+  }
+  if( filled < BLAKE2B_BLOCKBYTES && offset + filled - prefixlen < inlen )
+  {
+    size_t from = offset + filled - prefixlen;
+    size_t count = inlen - from < BLAKE2B_BLOCKBYTES - filled ? inlen - from : BLAKE2B_BLOCKBYTES - filled;
+    memcpy( block + filled, in + from, count );
+  }
+}
+
+/*
+ * Defines, for W inputs in registers of type VEC:
+ *   blake2b_multi_compress_<name>(h, m, t, f): one compression of the W states h with the message words m
+ *   blake2b_multi_hash_<name>(out, outlen, prefix, prefixlen, in, inlen): BLAKE2b(prefix || in[i]) for each input
+ *   blake2b_long_x<W>_<name>(out, in, outlen, inlen): blake2b_long() for each input
+ * The ISA-specific operations are ADD, XOR, ROR (by 32, 24, 16 or 63), SET1, SETW (from W words) and STORE.
+ */
+#define DEFINE_BLAKE2B_MULTI( W, VEC, name, TARGET ) \
+  TARGET static void blake2b_multi_compress_##name( VEC h[8], const VEC m[16], uint64_t t, uint64_t f ) \
+  { \
+    BLAKE2B_MULTI_SETUP \
+    VEC v[16]; \
+    for( int i = 0; i < 8; ++i ) v[i] = h[i]; \
+    for( int i = 0; i < 4; ++i ) v[i + 8] = SET1( blake2b_IV[i] ); \
+    v[12] = SET1( blake2b_IV[4] ^ t ); \
+    v[13] = SET1( blake2b_IV[5] ); \
+    v[14] = SET1( blake2b_IV[6] ^ f ); \
+    v[15] = SET1( blake2b_IV[7] ); \
+    for( int r = 0; r < 12; ++r ) \
+    { \
+      MULTI_G( r, 0, v[ 0], v[ 4], v[ 8], v[12] ); \
+      MULTI_G( r, 1, v[ 1], v[ 5], v[ 9], v[13] ); \
+      MULTI_G( r, 2, v[ 2], v[ 6], v[10], v[14] ); \
+      MULTI_G( r, 3, v[ 3], v[ 7], v[11], v[15] ); \
+      MULTI_G( r, 4, v[ 0], v[ 5], v[10], v[15] ); \
+      MULTI_G( r, 5, v[ 1], v[ 6], v[11], v[12] ); \
+      MULTI_G( r, 6, v[ 2], v[ 7], v[ 8], v[13] ); \
+      MULTI_G( r, 7, v[ 3], v[ 4], v[ 9], v[14] ); \
+    } \
+    for( int i = 0; i < 8; ++i ) h[i] = XOR( h[i], XOR( v[i], v[i + 8] ) ); \
+  } \
+  \
+  TARGET static void blake2b_multi_hash_##name( uint8_t *out[W], uint8_t outlen, const uint8_t *prefix, size_t prefixlen, \
+                                                const uint8_t *in[W], size_t inlen ) \
+  { \
+    uint64_t words[W][BLAKE2B_BLOCKBYTES / sizeof( uint64_t )]; \
+    uint64_t lanes[W]; \
+    VEC h[8]; \
+    VEC m[16]; \
+    size_t total = prefixlen + inlen; \
+    size_t blocks = ( total + BLAKE2B_BLOCKBYTES - 1 ) / BLAKE2B_BLOCKBYTES; \
+    if( blocks == 0 ) blocks = 1; \
+    for( int i = 0; i < 8; ++i ) h[i] = SET1( blake2b_IV[i] ); \
+    h[0] = XOR( h[0], SET1( 0x01010000ULL ^ outlen ) ); /* digest length, no key, fanout 1, depth 1 */ \
+    for( size_t k = 0; k < blocks; ++k ) \
+    { \
+      for( int b = 0; b < W; ++b ) \
+      { \
+        uint8_t block[BLAKE2B_BLOCKBYTES]; \
+        blake2b_multi_load_block( block, prefix, prefixlen, in[b], inlen, k ); \
+        for( int j = 0; j < 16; ++j ) words[b][j] = load64( block + j * sizeof( uint64_t ) ); \
+      } \
+      for( int j = 0; j < 16; ++j ) m[j] = SETW( words, j ); \
+      uint64_t t = ( k + 1 == blocks ) ? total : ( k + 1 ) * BLAKE2B_BLOCKBYTES; \
+      blake2b_multi_compress_##name( h, m, t, ( k + 1 == blocks ) ? ~0ULL : 0 ); \
+    } \
+    for( int i = 0; i < 8 && i * sizeof( uint64_t ) < outlen; ++i ) \
+    { \
+      STORE( lanes, h[i] ); \
+      for( int b = 0; b < W; ++b ) \
+      { \
+        uint8_t word[sizeof( uint64_t )]; \
+        size_t count = outlen - i * sizeof( uint64_t ) < sizeof( uint64_t ) ? outlen - i * sizeof( uint64_t ) : sizeof( uint64_t ); \
+        store64( word, lanes[b] ); \
+        memcpy( out[b] + i * sizeof( uint64_t ), word, count ); \
+      } \
+    } \
+    secure_zero_memory( words, sizeof( words ) ); \
+    secure_zero_memory( lanes, sizeof( lanes ) ); \
+  } \
+  \
+  TARGET int blake2b_long_x##W##_##name( uint8_t *out[W], const void *in[W], const uint32_t outlen, const uint64_t inlen ) \
+  { \
+    uint8_t out_buffer[W][BLAKE2B_OUTBYTES]; \
+    uint8_t in_buffer[W][BLAKE2B_OUTBYTES]; \
+    uint8_t *outs[W]; \
+    const uint8_t *ins[W]; \
+    for( int b = 0; b < W; ++b ) \
+    { \
+      ins[b] = ( const uint8_t * )in[b]; \
+      outs[b] = out_buffer[b]; \
+    } \
+    if( outlen <= BLAKE2B_OUTBYTES ) \
+    { \
+      blake2b_multi_hash_##name( out, outlen, ( const uint8_t * )&outlen, sizeof( uint32_t ), ins, inlen ); \
+      return 0; \
+    } \
+    blake2b_multi_hash_##name( outs, BLAKE2B_OUTBYTES, ( const uint8_t * )&outlen, sizeof( uint32_t ), ins, inlen ); \
+    for( int b = 0; b < W; ++b ) \
+    { \
+      memcpy( out[b], out_buffer[b], BLAKE2B_OUTBYTES / 2 ); \
+      ins[b] = in_buffer[b]; \
+    } \
+    uint32_t produced = BLAKE2B_OUTBYTES / 2; \
+    uint32_t toproduce = outlen - BLAKE2B_OUTBYTES / 2; \
+    while( toproduce > BLAKE2B_OUTBYTES ) \
+    { \
+      memcpy( in_buffer, out_buffer, sizeof( in_buffer ) ); \
+      blake2b_multi_hash_##name( outs, BLAKE2B_OUTBYTES, NULL, 0, ins, BLAKE2B_OUTBYTES ); \
+      for( int b = 0; b < W; ++b ) memcpy( out[b] + produced, out_buffer[b], BLAKE2B_OUTBYTES / 2 ); \
+      produced += BLAKE2B_OUTBYTES / 2; \
+      toproduce -= BLAKE2B_OUTBYTES / 2; \
+    } \
+    memcpy( in_buffer, out_buffer, sizeof( in_buffer ) ); \
+    blake2b_multi_hash_##name( outs, ( uint8_t )toproduce, NULL, 0, ins, BLAKE2B_OUTBYTES ); \
+    for( int b = 0; b < W; ++b ) memcpy( out[b] + produced, out_buffer[b], toproduce ); \
+    secure_zero_memory( out_buffer, sizeof( out_buffer ) ); \
+    secure_zero_memory( in_buffer, sizeof( in_buffer ) ); \
+    return 0; \
+  }
+
+#define MULTI_G( r, i, a, b, c, d ) \
+  do { \
+    a = ADD( ADD( a, b ), m[blake2b_sigma[r][2 * i + 0]] ); \
+    d = ROR( XOR( d, a ), 32 ); \
+    c = ADD( c, d ); \
+    b = ROR( XOR( b, c ), 24 ); \
+    a = ADD( ADD( a, b ), m[blake2b_sigma[r][2 * i + 1]] ); \
+    d = ROR( XOR( d, a ), 16 ); \
+    c = ADD( c, d ); \
+    b = ROR( XOR( b, c ), 63 ); \
+  } while( 0 )
+
+/* AVX2: 4 inputs */
+#define BLAKE2B_MULTI_SETUP \
+  const __m256i r16 = _mm256_setr_epi8( 2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9, \
+                                        2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9 ); \
+  const __m256i r24 = _mm256_setr_epi8( 3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10, \
+                                        3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10 );
+#define ADD( x, y ) _mm256_add_epi64( ( x ), ( y ) )
+#define XOR( x, y ) _mm256_xor_si256( ( x ), ( y ) )
+#define ROR( x, n ) _mm256_roti_epi64( ( x ), -( n ) )
+#define SET1( x ) _mm256_set1_epi64x( ( long long )( x ) )
+#define SETW( w, j ) _mm256_set_epi64x( ( long long )w[3][j], ( long long )w[2][j], ( long long )w[1][j], ( long long )w[0][j] )
+#define STORE( p, x ) _mm256_storeu_si256( ( __m256i * )( p ), ( x ) )
+
+DEFINE_BLAKE2B_MULTI( 4, __m256i, avx2, __attribute__((target("avx2"))) )
+
+#undef BLAKE2B_MULTI_SETUP
+#undef ADD
+#undef XOR
+#undef ROR
+#undef SET1
+#undef SETW
+#undef STORE
+
+/* AVX-512F: 8 inputs */
+#define BLAKE2B_MULTI_SETUP
+#define ADD( x, y ) _mm512_add_epi64( ( x ), ( y ) )
+#define XOR( x, y ) _mm512_xor_si512( ( x ), ( y ) )
+#define ROR( x, n ) _mm512_ror_epi64( ( x ), ( n ) )
+#define SET1( x ) _mm512_set1_epi64( ( long long )( x ) )
+#define SETW( w, j ) _mm512_set_epi64( ( long long )w[7][j], ( long long )w[6][j], ( long long )w[5][j], ( long long )w[4][j], \
+                                       ( long long )w[3][j], ( long long )w[2][j], ( long long )w[1][j], ( long long )w[0][j] )
+#define STORE( p, x ) _mm512_storeu_si512( ( void * )( p ), ( x ) )
+
+DEFINE_BLAKE2B_MULTI( 8, __m512i, avx512, __attribute__((target("avx512f"))) )
+
+#endif
+/* Argon2 Team - End Code */
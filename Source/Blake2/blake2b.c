@@ -18,6 +18,22 @@
 #include "blake2.h"
 #include "blake2-impl.h"
 
+/* Argon2 Team - Begin Code */
+/*
+ * In Argon2 this file only provides blake2b_compress_sse41(), picked at runtime by blake2b-ref.c, and is compiled for SSE4.1
+ * whatever the build flags. Define BLAKE2B_STANDALONE to build the complete BLAKE2b for the flags of the build instead.
+ */
+#if !defined(BLAKE2B_STANDALONE)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLAKE2B_COMPRESS_SSE41
+#define HAVE_SSE41
+#include <x86intrin.h>
+#endif
+#endif
+
+#if defined(BLAKE2B_STANDALONE) || defined(BLAKE2B_COMPRESS_SSE41)
+/* Argon2 Team - End Code */
+
 #include "blake2-config.h"
 
 
@@ -45,6 +61,9 @@ ALIGN( 64 ) static const uint64_t blake2b_IV[8] =
   0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL
 };
 
+/* Argon2 Team - Begin Code */
+#if !defined(HAVE_SSE41) /* the SSE4.1 message loads do not use the table */
+/* Argon2 Team - End Code */
 static const uint8_t blake2b_sigma[12][16] =
 {
   {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 } ,
@@ -60,6 +79,9 @@ static const uint8_t blake2b_sigma[12][16] =
   {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 } ,
   { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 }
 };
+/* Argon2 Team - Begin Code */
+#endif
+/* Argon2 Team - End Code */
 
 
 /* Some helper functions, not necessarily useful */
@@ -173,6 +195,9 @@ static inline int blake2b_init0( blake2b_state *S )
 }
 
 /* init xors IV with input parameter block */
+/* Argon2 Team - Begin Code */
+#if defined(BLAKE2B_STANDALONE)
+/* Argon2 Team - End Code */
 int blake2b_init_param( blake2b_state *S, const blake2b_param *P )
 {
   //blake2b_init0( S );
@@ -244,7 +269,17 @@ int blake2b_init_key( blake2b_state *S, const uint8_t outlen, const void *key, c
   return 0;
 }
 
+/* Argon2 Team - Begin Code */
+#endif
+/* Argon2 Team - End Code */
+
+/* Argon2 Team - Begin Code */
+#if defined(BLAKE2B_COMPRESS_SSE41)
+__attribute__((target("sse4.1"))) int blake2b_compress_sse41( blake2b_state *S, const uint8_t block[BLAKE2B_BLOCKBYTES] )
+#else
 static inline int blake2b_compress( blake2b_state *S, const uint8_t block[BLAKE2B_BLOCKBYTES] )
+#endif
+/* Argon2 Team - End Code */
 {
   __m128i row1l, row1h;
   __m128i row2l, row2h;
@@ -315,6 +350,9 @@ static inline int blake2b_compress( blake2b_state *S, const uint8_t block[BLAKE2
 }
 
 
+/* Argon2 Team - Begin Code */
+#if defined(BLAKE2B_STANDALONE)
+/* Argon2 Team - End Code */
 int blake2b_update( blake2b_state *S, const uint8_t *in, uint64_t inlen )
 {
   while( inlen > 0 )
@@ -468,4 +506,10 @@ int blake2b_long(uint8_t *out, const void *in, const uint32_t outlen, const uint
 	}
 	return 0;
 }
-/* Argon2 Team - End Code */
\ No newline at end of file
+/* Argon2 Team - End Code */
+
+/* Argon2 Team - Begin Code */
+#endif /* BLAKE2B_STANDALONE */
+
+#endif /* BLAKE2B_STANDALONE || BLAKE2B_COMPRESS_SSE41 */
+/* Argon2 Team - End Code */
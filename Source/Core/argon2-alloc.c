@@ -0,0 +1,393 @@
+/*
+ * Argon2 source code package
+ *
+ * This work is licensed under a Creative Commons CC0 1.0 License/Waiver.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+
+/*For MAP_ANONYMOUS, MAP_HUGETLB, madvise and mkstemp*/
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+/*For mapped files larger than 2 GiB on 32-bit systems*/
+#if !defined(_FILE_OFFSET_BITS)
+#define _FILE_OFFSET_BITS 64
+#endif
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HAVE_MMAP
+#endif
+
+#include "argon2.h"
+#include "argon2-core.h"
+
+
+/* Size of a huge page on x86-64 and of the alignment of the mappings */
+#define HUGE_PAGE_SIZE ((size_t) 1 << 21)
+
+/* Longest path of the file or directory backing Argon2_AllocateMappedFile */
+enum { MAPPED_PATH_LENGTH = 4096 };
+
+/* File or directory set by Argon2_SetMappedFile, empty if none */
+static char mapped_path[MAPPED_PATH_LENGTH];
+
+/*
+ * A file or device set by Argon2_SetMappedFile backs one allocation at a time: its mapping, if any, and the
+ * descriptor kept to empty the file again when it is freed
+ */
+static pthread_mutex_t mapped_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t* mapped_memory = NULL;
+static int mapped_fd = -1;
+
+
+#ifdef HAVE_MMAP
+
+static size_t HugePageLength(size_t bytes) {
+    return (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+}
+
+/* Maps @a length bytes aligned to HUGE_PAGE_SIZE, so that transparent huge pages can back all of them */
+static void* MapAligned(size_t length) {
+    uint8_t* memory = mmap(NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return NULL;
+    }
+    // Trim the unaligned head, if any, and the tail, which is never empty: head + tail is the extra HUGE_PAGE_SIZE
+    size_t head = (HUGE_PAGE_SIZE - ((uintptr_t) memory & (HUGE_PAGE_SIZE - 1))) & (HUGE_PAGE_SIZE - 1);
+    if (head != 0) {
+        munmap(memory, head);
+    }
+    munmap(memory + head + length, HUGE_PAGE_SIZE - head);
+    return memory + head;
+}
+
+int Argon2_AllocateHugePages(uint8_t **memory, size_t bytes_to_allocate) {
+    if (memory == NULL || bytes_to_allocate == 0) {
+        return ARGON2_MEMORY_ALLOCATION_ERROR;
+    }
+    size_t length = HugePageLength(bytes_to_allocate);
+    void* mapping = MAP_FAILED;
+
+#if defined(MAP_HUGETLB)
+    // 1. Explicit huge pages, if the administrator reserved enough of them
+    mapping = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (mapping == MAP_FAILED) {
+        // 2. Transparent huge pages, 3. regular pages if they are disabled
+        mapping = MapAligned(length);
+        if (mapping == NULL) {
+            return ARGON2_MEMORY_ALLOCATION_ERROR;
+        }
+#if defined(MADV_HUGEPAGE)
+        madvise(mapping, length, MADV_HUGEPAGE); // best effort
+#endif
+    }
+
+    *memory = mapping;
+    return ARGON2_OK;
+}
+
+void Argon2_FreeHugePages(uint8_t *memory, size_t bytes_to_allocate) {
+    if (memory != NULL) {
+        munmap(memory, HugePageLength(bytes_to_allocate));
+    }
+}
+
+/*
+ * Opens the file backing a mapping of @a length bytes: a new unlinked file in the directory, or the file or device itself.
+ * An existing file that is not empty is refused rather than overwritten
+ * @param shared Pointer receiving whether the file or device is the one set, rather than a new file of the directory
+ */
+static int OpenMappedFile(size_t length, bool* shared) {
+    struct stat status;
+    if (0 != stat(mapped_path, &status)) {
+        // A file to be created
+        status.st_mode = S_IFREG;
+    }
+
+    int fd;
+    *shared = !S_ISDIR(status.st_mode);
+    if (S_ISDIR(status.st_mode)) {
+        char name[MAPPED_PATH_LENGTH + 32];
+        if (snprintf(name, sizeof (name), "%s/argon2-XXXXXX", mapped_path) >= (int) sizeof (name)) {
+            return -1;
+        }
+        fd = mkstemp(name);
+        if (fd < 0) {
+            return -1;
+        }
+        // The file disappears with the mapping
+        unlink(name);
+    } else {
+        fd = open(mapped_path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+        if (fd < 0) {
+            return -1;
+        }
+        // The file now opened, which may not be the one tested above
+        if (0 != fstat(fd, &status) || (S_ISREG(status.st_mode) && status.st_size != 0)) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    if (S_ISBLK(status.st_mode)) {
+        // A device cannot be extended, a mapping beyond its end would fault
+        off_t size = lseek(fd, 0, SEEK_END);
+        if (size < 0 || (uint64_t) size < (uint64_t) length) {
+            close(fd);
+            return -1;
+        }
+    } else if (0 != ftruncate(fd, (off_t) length)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int Argon2_SetMappedFile(const char* path) {
+    if (path == NULL) {
+        mapped_path[0] = '\0';
+        return ARGON2_OK;
+    }
+    if (strlen(path) >= MAPPED_PATH_LENGTH) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+    strcpy(mapped_path, path);
+    return ARGON2_OK;
+}
+
+int Argon2_AllocateMappedFile(uint8_t **memory, size_t bytes_to_allocate) {
+    if (memory == NULL || bytes_to_allocate == 0 || mapped_path[0] == '\0') {
+        return ARGON2_MEMORY_ALLOCATION_ERROR;
+    }
+    // The set file or device holds the blocks of a single hash: a concurrent allocation fails rather than share it
+    pthread_mutex_lock(&mapped_lock);
+    if (mapped_fd >= 0) {
+        pthread_mutex_unlock(&mapped_lock);
+        return ARGON2_MEMORY_ALLOCATION_ERROR;
+    }
+    bool shared;
+    int fd = OpenMappedFile(bytes_to_allocate, &shared);
+    if (fd < 0) {
+        pthread_mutex_unlock(&mapped_lock);
+        return ARGON2_MEMORY_ALLOCATION_ERROR;
+    }
+    // Shared, so that the kernel writes the pages back to the file rather than to swap
+    void* mapping = mmap(NULL, bytes_to_allocate, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (shared && mapping != MAP_FAILED) {
+        mapped_memory = mapping;
+        mapped_fd = fd;
+    } else {
+        if (shared) {
+            // The allocation fails anyway; a file left not empty is refused by the next one rather than overwritten
+            int emptied = ftruncate(fd, 0);
+            (void) emptied;
+        }
+        close(fd); // the mapping keeps the file open
+    }
+    pthread_mutex_unlock(&mapped_lock);
+    if (mapping == MAP_FAILED) {
+        return ARGON2_MEMORY_ALLOCATION_ERROR;
+    }
+    // Blocks are written in order within a lane but read at random: readahead would only
+    // fetch pages that are overwritten before being read
+    madvise(mapping, bytes_to_allocate, MADV_RANDOM); // best effort
+
+    *memory = mapping;
+    return ARGON2_OK;
+}
+
+void Argon2_FreeMappedFile(uint8_t *memory, size_t bytes_to_allocate) {
+    if (memory != NULL) {
+        munmap(memory, bytes_to_allocate);
+        pthread_mutex_lock(&mapped_lock);
+        if (memory == mapped_memory) {
+            // A file is emptied, so that the next allocation accepts it; a device keeps its (wiped, if requested) content
+            struct stat status;
+            if (0 == fstat(mapped_fd, &status) && S_ISREG(status.st_mode)) {
+                // A free_cbk cannot report errors; a file left not empty is refused by the next allocation rather than overwritten
+                int emptied = ftruncate(mapped_fd, 0);
+                (void) emptied;
+            }
+            close(mapped_fd);
+            mapped_memory = NULL;
+            mapped_fd = -1;
+        }
+        pthread_mutex_unlock(&mapped_lock);
+    }
+}
+
+#else /* no mmap: plain heap memory */
+
+int Argon2_AllocateHugePages(uint8_t **memory, size_t bytes_to_allocate) {
+    if (memory == NULL) {
+        return ARGON2_MEMORY_ALLOCATION_ERROR;
+    }
+    *memory = malloc(bytes_to_allocate);
+    return (*memory != NULL) ? ARGON2_OK : ARGON2_MEMORY_ALLOCATION_ERROR;
+}
+
+void Argon2_FreeHugePages(uint8_t *memory, size_t bytes_to_allocate) {
+    (void) bytes_to_allocate;
+    free(memory);
+}
+
+int Argon2_SetMappedFile(const char* path) {
+    (void) path;
+    return ARGON2_INCORRECT_PARAMETER;
+}
+
+int Argon2_AllocateMappedFile(uint8_t **memory, size_t bytes_to_allocate) {
+    (void) memory;
+    (void) bytes_to_allocate;
+    return ARGON2_MEMORY_ALLOCATION_ERROR;
+}
+
+void Argon2_FreeMappedFile(uint8_t *memory, size_t bytes_to_allocate) {
+    (void) memory;
+    (void) bytes_to_allocate;
+}
+
+#endif
+
+
+uint64_t* AllocateSbox(void) {
+    void* Sbox = NULL;
+#if defined(_MSC_VER)
+    Sbox = _aligned_malloc(SBOX_BUFFERS * SBOX_SIZE * sizeof (uint64_t), SBOX_ALIGNMENT);
+#elif defined(HAVE_MMAP)
+    if (0 != posix_memalign(&Sbox, SBOX_ALIGNMENT, SBOX_BUFFERS * SBOX_SIZE * sizeof (uint64_t))) {
+        Sbox = NULL;
+    }
+#else
+    Sbox = malloc(SBOX_BUFFERS * SBOX_SIZE * sizeof (uint64_t));
+#endif
+    return (uint64_t*) Sbox;
+}
+
+void FreeSbox(uint64_t* Sbox) {
+#if defined(_MSC_VER)
+    _aligned_free(Sbox);
+#else
+    free(Sbox);
+#endif
+}
+
+
+Argon2_Arena* Argon2_ArenaCreate(uint32_t m_cost, uint32_t lanes) {
+    // The memory cost is rounded as in Argon2Core(), to at most this number of blocks
+    uint32_t memory_blocks = m_cost;
+    if (memory_blocks < 2 * SYNC_POINTS * lanes) {
+        memory_blocks = 2 * SYNC_POINTS * lanes;
+    }
+
+    Argon2_Arena* arena = malloc(sizeof (Argon2_Arena));
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->memory_blocks = memory_blocks;
+    arena->wiping = false;
+    arena->wipe_pool = NULL;
+    arena->in_use = false;
+    arena->Sbox = AllocateSbox();
+    if (arena->Sbox == NULL ||
+            ARGON2_OK != Argon2_AllocateHugePages((uint8_t **) &arena->memory, (size_t) memory_blocks * sizeof (block))) {
+        FreeSbox(arena->Sbox);
+        free(arena);
+        return NULL;
+    }
+
+    // Fault all pages in now rather than during the first calls
+    memset(arena->memory, 0, (size_t) memory_blocks * sizeof (block));
+    memset(arena->Sbox, 0, SBOX_BUFFERS * SBOX_SIZE * sizeof (uint64_t));
+    pthread_mutex_init(&arena->lock, NULL);
+    pthread_cond_init(&arena->released, NULL);
+    return arena;
+}
+
+void Argon2_ArenaDestroy(Argon2_Arena* arena) {
+    if (arena == NULL) {
+        return;
+    }
+    ArenaWaitWipe(arena);
+    pthread_cond_destroy(&arena->released);
+    pthread_mutex_destroy(&arena->lock);
+    secure_wipe_memory(arena->memory, (size_t) arena->memory_blocks * sizeof (block));
+    secure_wipe_memory(arena->Sbox, SBOX_BUFFERS * SBOX_SIZE * sizeof (uint64_t));
+    Argon2_FreeHugePages((uint8_t *) arena->memory, (size_t) arena->memory_blocks * sizeof (block));
+    FreeSbox(arena->Sbox);
+    free(arena);
+}
+
+int ArenaDeferWipe(Argon2_Arena* arena, Argon2_ThreadPool* pool, Argon2_job_t job, void* arg) {
+    // Queued and marked at once, so that a waiter seeing the wipe finds it in the queue or running
+    pthread_mutex_lock(&arena->lock);
+    int result = SubmitUrgentJob(pool, job, arg);
+    if (ARGON2_OK == result) {
+        arena->wiping = true;
+        arena->wipe_pool = pool;
+    }
+    pthread_mutex_unlock(&arena->lock);
+    return result;
+}
+
+void ArenaEndWipe(Argon2_Arena* arena) {
+    pthread_mutex_lock(&arena->lock);
+    arena->wiping = false;
+    pthread_cond_broadcast(&arena->released);
+    pthread_mutex_unlock(&arena->lock);
+}
+
+/*
+ * Waits until no deferred wipe of the arena memory is running. A wipe still queued is run by the calling thread:
+ * the workers may all be waiting for it. Must be called with the arena lock held
+ */
+static void WaitWipeLocked(Argon2_Arena* arena) {
+    while (arena->wiping) {
+        Argon2_ThreadPool* pool = arena->wipe_pool;
+        pthread_mutex_unlock(&arena->lock);
+        bool ran = RunUrgentJob(pool);
+        pthread_mutex_lock(&arena->lock);
+        if (!ran && arena->wiping) {
+            // Claimed by another thread, which signals the end of the wipe
+            pthread_cond_wait(&arena->released, &arena->lock);
+        }
+    }
+}
+
+void ArenaWaitWipe(Argon2_Arena* arena) {
+    pthread_mutex_lock(&arena->lock);
+    WaitWipeLocked(arena);
+    pthread_mutex_unlock(&arena->lock);
+}
+
+int ArenaAcquire(Argon2_Arena* arena) {
+    int result = ARGON2_OK;
+    pthread_mutex_lock(&arena->lock);
+    WaitWipeLocked(arena);
+    if (arena->in_use) {
+        result = ARGON2_ARENA_BUSY;
+    } else {
+        arena->in_use = true;
+    }
+    pthread_mutex_unlock(&arena->lock);
+    return result;
+}
+
+void ArenaRelease(Argon2_Arena* arena) {
+    pthread_mutex_lock(&arena->lock);
+    arena->in_use = false;
+    pthread_mutex_unlock(&arena->lock);
+}
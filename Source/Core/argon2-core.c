@@ -18,13 +18,23 @@
 #endif
 #define VC_GE_2005( version )		( version >= 1400 )
 
+/*For clock_gettime (timing statistics)*/
+#if defined(ARGON2_STATS) && !defined(_MSC_VER) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
 
 #include <stdlib.h>
 #include <inttypes.h>
 #include <string.h>
+#include <pthread.h>
+#ifdef ARGON2_STATS
+#include <time.h>
+#endif
 
 #include "argon2.h"
 #include "argon2-core.h"
+#include "argon2-thread.h"
 #include "kat.h"
 
 
@@ -57,19 +67,14 @@ int AllocateMemory(block **memory, uint32_t m_cost) {
     if (memory == NULL) {
         return ARGON2_MEMORY_ALLOCATION_ERROR;
     }
-    *memory = malloc(m_cost * sizeof(block));
+    *memory = malloc((size_t) m_cost * sizeof(block));
     if (!*memory) {
         return ARGON2_MEMORY_ALLOCATION_ERROR;
     }
     return ARGON2_OK;
 }
 
-/* Function that securely cleans the memory
-* @param mem Pointer to the memory
-* @param s Memory size in bytes
-*/
-
-static inline void NOT_OPTIMIZED secure_wipe_memory( void *v, size_t n )
+void NOT_OPTIMIZED secure_wipe_memory( void *v, size_t n )
 {
 #if defined  (_MSC_VER ) &&  VC_GE_2005( _MSC_VER )
     SecureZeroMemory(v,n);
@@ -83,50 +88,204 @@ static inline void NOT_OPTIMIZED secure_wipe_memory( void *v, size_t n )
 #endif
 } 
 
-void FreeMemory(Argon2_instance_t* instance, bool clear) {
-    if (instance->state != NULL) {
-        if (clear) {
-            if (instance->type == Argon2_ds && instance->Sbox != NULL) {
-                secure_wipe_memory(instance->Sbox, SBOX_SIZE * sizeof (uint64_t));
-            }
-            secure_wipe_memory(instance->state, sizeof (block) * instance->memory_blocks);
-        }
-        free(instance->state);
-        if (instance->Sbox != NULL) {
-            free(instance->Sbox);
-        }
+/*
+ * Argon2 wipe data: the memory wiped in chunks of WIPE_CHUNK_BYTES, one job per chunk
+ */
+enum { WIPE_CHUNK_BYTES = 1 << 24 };
+
+typedef struct Argon2_wipe_data_t Argon2_wipe_data_t;
+struct Argon2_wipe_data_t {
+    uint8_t* memory;
+    size_t size;
+};
+
+static void WipeChunkJob(void* wipe_data, uint32_t chunk) {
+    const Argon2_wipe_data_t* my_data = (const Argon2_wipe_data_t*) wipe_data;
+    size_t offset = (size_t) chunk * WIPE_CHUNK_BYTES;
+    size_t size = (my_data->size - offset < WIPE_CHUNK_BYTES) ? my_data->size - offset : WIPE_CHUNK_BYTES;
+    secure_wipe_memory(my_data->memory + offset, size);
+}
+
+void WipeMemory(Argon2_ThreadPool* pool, void *v, size_t n) {
+    size_t chunks = (n + WIPE_CHUNK_BYTES - 1) / WIPE_CHUNK_BYTES;
+    if (pool == NULL || chunks < 2) {
+        // Not worth a thread per chunk
+        secure_wipe_memory(v, n);
+        return;
+    }
+    Argon2_wipe_data_t wipe_data = {(uint8_t*) v, n};
+    RunInParallel(pool, WipeChunkJob, &wipe_data, (uint32_t) chunks);
+}
+
+/*
+ * Argon2 reduction data: the last blocks of the lanes XORed in groups of FINALIZE_GROUP_LANES, one job per group
+ */
+enum { FINALIZE_GROUP_LANES = 8 };
+
+typedef struct Argon2_reduction_data_t Argon2_reduction_data_t;
+struct Argon2_reduction_data_t {
+    const Argon2_instance_t* instance;
+    block* partial; //XOR of the last blocks of each group
+};
+
+static void XORLastBlocksJob(void* reduction_data, uint32_t group) {
+    const Argon2_reduction_data_t* my_data = (const Argon2_reduction_data_t*) reduction_data;
+    const Argon2_instance_t* instance = my_data->instance;
+    uint32_t first = group * FINALIZE_GROUP_LANES;
+    uint32_t last = (first + FINALIZE_GROUP_LANES < instance->lanes) ? first + FINALIZE_GROUP_LANES : instance->lanes;
+
+    memmove(my_data->partial[group], instance->state[first * instance->lane_length + (instance->lane_length - 1)], sizeof(block));
+    for (uint32_t l = first + 1; l < last; ++l) {
+        uint32_t last_block_in_lane = l * instance->lane_length + (instance->lane_length - 1);
+        XORBlocks(my_data->partial[group], my_data->partial[group], instance->state[last_block_in_lane]);
     }
 }
 
 void Finalize(const Argon2_Context *context, Argon2_instance_t* instance) {
     if (context != NULL && instance != NULL) {
+        STATS_START(instance->stats, start);
         block blockhash;
-        memmove(blockhash, instance->state[instance->lane_length - 1], sizeof(block));
-
-        // XOR the last blocks
-        for (uint8_t l = 1; l < instance->lanes; ++l) {
-            uint32_t last_block_in_lane = l * instance->lane_length + (instance->lane_length - 1);
-            XORBlocks(blockhash, blockhash, instance->state[last_block_in_lane]);
+        uint32_t groups = (instance->lanes + FINALIZE_GROUP_LANES - 1) / FINALIZE_GROUP_LANES;
+
+        // XOR the last blocks: groups of lanes on the workers, then the groups
+        if (instance->thread_pool != NULL && groups > 1) {
+            block partial[groups];
+            Argon2_reduction_data_t reduction_data = {instance, partial};
+            RunInParallel(instance->thread_pool, XORLastBlocksJob, &reduction_data, groups);
+            memmove(blockhash, partial[0], sizeof(block));
+            for (uint32_t g = 1; g < groups; ++g) {
+                XORBlocks(blockhash, blockhash, partial[g]);
+            }
+            secure_wipe_memory(partial, groups * sizeof(block));
+        } else {
+            memmove(blockhash, instance->state[instance->lane_length - 1], sizeof(block));
+            for (uint8_t l = 1; l < instance->lanes; ++l) {
+                uint32_t last_block_in_lane = l * instance->lane_length + (instance->lane_length - 1);
+                XORBlocks(blockhash, blockhash, instance->state[last_block_in_lane]);
+            }
         }
 
+        STATS_ADD(instance->stats, finalize_ns, start);
+
+        // The memory is not needed anymore: a deferred wipe overlaps with the hash
+        ReleaseMemory(context, instance);
+
         // Hash the result
+        STATS_START(instance->stats, hash_start);
         blake2b_long(context->out, (uint8_t*) blockhash, context->outlen, BLOCK_SIZE);
         secure_wipe_memory(blockhash,  BLOCK_SIZE); //clear the blockhash
 #ifdef KAT
         PrintTag(context->out, context->outlen);
 #endif 
+        STATS_ADD(instance->stats, finalize_ns, hash_start);
+    }
+}
 
-        // Deallocate the memory
-        if (NULL != context->free_cbk) {
-            context->free_cbk((uint8_t *) instance->state, instance->memory_blocks * sizeof (block));
-        } else {
-            FreeMemory(instance, context->clear_memory);
+/*
+ * Argon2 release data: what is needed to wipe and deallocate the memory of an instance, copied for a deferred release
+ * as the context and the instance may be gone by then
+ */
+typedef struct Argon2_release_data_t Argon2_release_data_t;
+struct Argon2_release_data_t {
+    block* state;
+    uint32_t memory_blocks;
+    uint64_t* Sbox_memory;
+    enum Argon2_type type;
+    bool clear_memory;
+    FreeMemoryCallback free_cbk;
+    Argon2_Arena* arena;
+    Argon2_ThreadPool* thread_pool;
+};
+
+static void Release(const Argon2_release_data_t* release_data) {
+    // Deallocate the memory, or keep it in the arena
+    if (NULL != release_data->arena) {
+        if (release_data->clear_memory) {
+            if (release_data->type == Argon2_ds && release_data->Sbox_memory != NULL) {
+                secure_wipe_memory(release_data->Sbox_memory, SBOX_BUFFERS * SBOX_SIZE * sizeof (uint64_t));
+            }
+            WipeMemory(release_data->thread_pool, release_data->state, (size_t) release_data->memory_blocks * sizeof (block));
+        }
+    } else if (NULL != release_data->free_cbk) {
+        if (release_data->Sbox_memory != NULL) {
+            if (release_data->clear_memory) {
+                secure_wipe_memory(release_data->Sbox_memory, SBOX_BUFFERS * SBOX_SIZE * sizeof (uint64_t));
+            }
+            FreeSbox(release_data->Sbox_memory);
+        }
+        // The memory may outlive the call, e.g. in a mapped file or device
+        if (release_data->clear_memory) {
+            WipeMemory(release_data->thread_pool, release_data->state, (size_t) release_data->memory_blocks * sizeof (block));
         }
+        release_data->free_cbk((uint8_t *) release_data->state, (size_t) release_data->memory_blocks * sizeof (block));
+    } else if (release_data->state != NULL) {
+        if (release_data->clear_memory) {
+            if (release_data->type == Argon2_ds && release_data->Sbox_memory != NULL) {
+                secure_wipe_memory(release_data->Sbox_memory, SBOX_BUFFERS * SBOX_SIZE * sizeof (uint64_t));
+            }
+            WipeMemory(release_data->thread_pool, release_data->state, (size_t) release_data->memory_blocks * sizeof (block));
+        }
+        free(release_data->state);
+        FreeSbox(release_data->Sbox_memory);
+    }
+}
 
+/* Deferred release run by a worker: the arena, if any, can be used again once the memory is wiped */
+static void ReleaseJob(void* release_data, uint32_t index) {
+    Argon2_release_data_t* my_data = (Argon2_release_data_t*) release_data;
+    (void) index;
+    Release(my_data);
+    if (NULL != my_data->arena) {
+        ArenaEndWipe(my_data->arena);
     }
+    free(my_data);
 }
 
-uint32_t IndexAlpha(const Argon2_instance_t* instance, const Argon2_position_t* position, uint32_t pseudo_rand, bool same_lane) {
+void ReleaseMemory(const Argon2_Context *context, Argon2_instance_t* instance) {
+    if (context != NULL && instance != NULL) {
+        STATS_START(instance->stats, start);
+        Argon2_release_data_t release_data = {
+            .state = instance->state,
+            .memory_blocks = instance->memory_blocks,
+            .Sbox_memory = instance->Sbox_memory,
+            .type = instance->type,
+            .clear_memory = context->clear_memory,
+            .free_cbk = context->free_cbk,
+            .arena = context->arena,
+            .thread_pool = instance->thread_pool
+        };
+
+        // Hand the wipe of the library's memory to a worker if requested, or do it now if it cannot be queued.
+        // Memory given back to free_cbk is wiped and returned before the call returns, as the caller owns it
+        bool library_memory = NULL != context->arena || NULL == context->free_cbk;
+        bool deferred = false;
+        if (context->defer_wipe && context->clear_memory && library_memory && NULL != instance->thread_pool) {
+            Argon2_release_data_t* deferred_data = malloc(sizeof (Argon2_release_data_t));
+            if (NULL != deferred_data) {
+                *deferred_data = release_data;
+                // Ahead of the queued hashes, which may wait for it to reuse the arena
+                if (NULL != release_data.arena) {
+                    deferred = (ARGON2_OK == ArenaDeferWipe(release_data.arena, instance->thread_pool, ReleaseJob, deferred_data));
+                } else {
+                    deferred = (ARGON2_OK == SubmitUrgentJob(instance->thread_pool, ReleaseJob, deferred_data));
+                }
+                if (!deferred) {
+                    free(deferred_data);
+                }
+            }
+        }
+        if (!deferred) {
+            Release(&release_data);
+        }
+        if (NULL != release_data.arena) {
+            ArenaRelease(release_data.arena);
+        }
+        STATS_ADD(instance->stats, release_ns, start);
+
+    }
+}
+
+void InitReferenceArea(const Argon2_instance_t* instance, const Argon2_position_t* position, Argon2_reference_area_t* area) {
     /*
      * Pass 0:
      *      This lane : all already finished segments plus already constructed blocks in this segment
@@ -135,64 +294,170 @@ uint32_t IndexAlpha(const Argon2_instance_t* instance, const Argon2_position_t*
      *      This lane : (SYNC_POINTS - 1) last segments plus already constructed blocks in this segment
      *      Other lanes : (SYNC_POINTS - 1) last segments 
      */
-    uint32_t reference_area_size;
-
     if (0 == position->pass) {
-        // First pass
-        if (0 == position->slice) {
-            // First slice
-            reference_area_size = position->index - 1; // all but the previous
-        } else {
-            if (same_lane) {
-                // The same lane => add current segment
-                reference_area_size = position->slice * instance->segment_length + position->index - 1;
-            } else {
-                reference_area_size = position->slice * instance->segment_length + ((position->index == 0) ? (-1) : 0);
-            }
-        }
+        area->base_size = position->slice * instance->segment_length;
     } else {
-        // Second pass
-        if (same_lane) {
-            reference_area_size = instance->lane_length - instance->segment_length + position->index - 1;
-        } else {
-            reference_area_size = instance->lane_length - instance->segment_length + ((position->index == 0) ? (-1) : 0);
-        }
+        area->base_size = instance->lane_length - instance->segment_length;
     }
 
-    /* 1.2.4. Mapping pseudo_rand to 0..<reference_area_size-1> and produce relative position */
-    uint64_t relative_position = pseudo_rand;
-    relative_position = relative_position * relative_position >> 32;
-    relative_position = reference_area_size - 1 - (reference_area_size * relative_position >> 32);
-
     /* 1.2.5 Computing starting position */
-    uint32_t start_position = 0;
+    area->start_position = 0;
     if (0 != position->pass) {
-        start_position = (position->slice == SYNC_POINTS - 1) ? 0 : (position->slice + 1) * instance->segment_length;
+        area->start_position = (position->slice == SYNC_POINTS - 1) ? 0 : (position->slice + 1) * instance->segment_length;
     }
 
-    /* 1.2.6. Computing absolute position */
-    uint32_t absolute_position = (start_position + relative_position) % instance->lane_length; // absolute position
-    return absolute_position;
+    area->lane_length = instance->lane_length;
+    area->lanes = instance->lanes;
+    area->lanes_reciprocal = UINT64_C(0xFFFFFFFFFFFFFFFF) / instance->lanes + 1;
+    area->same_lane_only = (position->pass == 0) && (position->slice == 0);
 }
 
-void FillMemoryBlocks(Argon2_instance_t* instance) {
-    // TODO: threading
-    if (instance != NULL) {
-        for (uint8_t r = 0; r < instance->passes; ++r) {
-            if (Argon2_ds == instance->type) {
-                GenerateSbox(instance);
-            }
-            for (uint8_t s = 0; s < SYNC_POINTS; ++s) {
-                for (uint8_t l = 0; l < instance->lanes; ++l) {
-                    Argon2_position_t pos = {r, l, s, 0};
-                    FillSegment(instance, pos);
-                }
+uint32_t IndexAlpha(const Argon2_instance_t* instance, const Argon2_position_t* position, uint32_t pseudo_rand, bool same_lane) {
+    Argon2_reference_area_t area;
+    InitReferenceArea(instance, position, &area);
+    return ReferenceIndex(&area, position->index, pseudo_rand, same_lane);
+}
+
+/* Implementation used by new instances */
+static const Argon2_core_t* selected_core = &Argon2_ref_core;
+static pthread_once_t default_core_once = PTHREAD_ONCE_INIT;
+
+/* Returns the fastest implementation supported by the CPU */
+static const Argon2_core_t* FastestCore(void) {
+    for (int impl = MAX_ARGON2_IMPL - 1; impl > ARGON2_IMPL_REF; --impl) {
+        const Argon2_core_t* core = GetOptCore((enum Argon2_impl) impl);
+        if (core != NULL) {
+            return core;
+        }
+    }
+    return &Argon2_ref_core;
+}
+
+/* Sets the implementation for new instances */
+static void SetCore(const Argon2_core_t* core) {
+    selected_core = core;
+}
+
+static void SelectDefaultCore(void) {
+    SetCore(FastestCore());
+}
+
+int SelectCore(enum Argon2_impl impl) {
+    const Argon2_core_t* core = NULL;
+    if (ARGON2_IMPL_AUTO == impl) {
+        core = FastestCore();
+    } else if (ARGON2_IMPL_REF == impl) {
+        core = &Argon2_ref_core;
+    } else {
+        core = GetOptCore(impl);
+    }
+    if (core == NULL) {
+        return ARGON2_IMPL_NOT_SUPPORTED;
+    }
+    // Keep the default selection from overwriting this one later
+    pthread_once(&default_core_once, SelectDefaultCore);
+    SetCore(core);
+    return ARGON2_OK;
+}
+
+const Argon2_core_t* CurrentCore(void) {
+    pthread_once(&default_core_once, SelectDefaultCore);
+    return selected_core;
+}
+
+void FillSegment(const Argon2_instance_t* instance, Argon2_position_t position) {
+    instance->core->fill_segment(instance, position);
+}
+
+void InitAddressInput(const Argon2_instance_t* instance, const Argon2_position_t* position, uint64_t* input_block) {
+    memset(input_block, 0, sizeof(block));
+    input_block[0] = position->pass;
+    input_block[1] = position->lane;
+    input_block[2] = position->slice;
+    input_block[3] = instance->memory_blocks;
+    input_block[4] = instance->passes;
+    input_block[5] = instance->type;
+}
+
+void GenerateAddresses(const Argon2_instance_t* instance, uint64_t* input_block, uint64_t* address_block) {
+    instance->core->generate_addresses(input_block, address_block);
+}
+
+void GenerateSbox(const Argon2_instance_t* instance, uint64_t* Sbox) {
+    STATS_START(instance->stats, start);
+    instance->core->generate_sbox(instance->state[0], Sbox);
+    STATS_ADD(instance->stats, sbox_ns, start);
+}
+
+/*
+ * Argon2 slice data: the slice whose segments are filled in parallel, one job per lane,
+ * plus one job generating the Sbox of the next pass if next_Sbox is not NULL
+ */
+typedef struct Argon2_slice_data_t Argon2_slice_data_t;
+struct Argon2_slice_data_t {
+    const Argon2_instance_t* instance;
+    uint32_t pass;
+    uint8_t slice;
+    uint64_t* next_Sbox;
+};
+
+static void FillSegmentJob(void* slice_data, uint32_t lane) {
+    const Argon2_slice_data_t* my_data = (const Argon2_slice_data_t*) slice_data;
+    if (lane == my_data->instance->lanes) {
+        GenerateSbox(my_data->instance, my_data->next_Sbox);
+        return;
+    }
+    Argon2_position_t position = {my_data->pass, (uint8_t) lane, my_data->slice, 0};
+    STATS_START(my_data->instance->stats, start);
+    FillSegment(my_data->instance, position);
+    STATS_ADD_ENTRY(my_data->instance->stats, segment_ns, (my_data->pass * SYNC_POINTS + my_data->slice) * my_data->instance->lanes + lane, start);
+}
+
+/* Returns the Sbox buffer not used by the current pass */
+static uint64_t* OtherSbox(const Argon2_instance_t* instance) {
+    return (instance->Sbox == instance->Sbox_memory) ? instance->Sbox_memory + SBOX_SIZE : instance->Sbox_memory;
+}
+
+void FillSlice(Argon2_instance_t* instance, uint32_t pass, uint8_t slice) {
+    /*
+     * Argon2ds: the Sbox of a pass is generated from block 0 of lane 0 as it is at the start of the pass.
+     * Pass 0 does not overwrite that block, so pass 1 keeps the Sbox of pass 0. Later passes overwrite it
+     * in slice 0 only, so the Sbox of pass r + 1 is generated into the other buffer alongside slice 1
+     * of pass r, and swapped in at the start of pass r + 1.
+     */
+    STATS_START(instance->stats, start);
+    uint64_t* next_Sbox = NULL;
+    if (Argon2_ds == instance->type) {
+        if (0 == slice) {
+            if (0 == pass) {
+                GenerateSbox(instance, instance->Sbox);
+            } else if (pass >= 2) {
+                instance->Sbox = OtherSbox(instance);
             }
+        } else if (1 == slice && pass >= 1 && pass + 1 < instance->passes) {
+            next_Sbox = OtherSbox(instance);
+        }
+    }
+
+    // Fill the segments of all lanes; returns at the synchronization point
+    Argon2_slice_data_t slice_data = {instance, pass, slice, next_Sbox};
+    RunInParallel(instance->thread_pool, FillSegmentJob, &slice_data, instance->lanes + (next_Sbox != NULL));
+    STATS_ADD(instance->stats, fill_ns, start);
+    STATS_ADD_ENTRY(instance->stats, pass_ns, pass, start);
 
 #ifdef KAT_INTERNAL
-            InternalKat(instance, r);
+    if (SYNC_POINTS - 1 == slice) {
+        InternalKat(instance, pass);
+    }
 #endif
+}
 
+void FillMemoryBlocks(Argon2_instance_t* instance) {
+    if (instance != NULL) {
+        for (uint32_t r = 0; r < instance->passes; ++r) {
+            for (uint8_t s = 0; s < SYNC_POINTS; ++s) {
+                FillSlice(instance, r, s);
+            }
         }
     }
 }
@@ -305,15 +570,50 @@ int ValidateInputs(const Argon2_Context* context) {
     return ARGON2_OK;
 }
 
-void FillFirstBlocks(uint8_t* blockhash, const Argon2_instance_t* instance) {
-    // Make the first and second block in each lane as G(H0||i||0) or G(H0||i||1)
-    for (uint8_t l = 0; l < instance->lanes; ++l) {
-        blockhash[PREHASH_DIGEST_LENGTH + 4] = l;
-        blockhash[PREHASH_DIGEST_LENGTH] = 0;
-        blake2b_long((uint8_t*) (instance->state[l * instance->lane_length]), blockhash, BLOCK_SIZE, PREHASH_SEED_LENGTH);
+/*
+ * Argon2 first blocks data: the pre-hashing digest extended into the first two blocks, one job per group of
+ * FIRST_BLOCKS_GROUP_LANES lanes so that the 2 * FIRST_BLOCKS_GROUP_LANES hashes run side by side in blake2b_long_xN()
+ */
+enum { FIRST_BLOCKS_GROUP_LANES = 4 };
+
+typedef struct Argon2_first_blocks_data_t Argon2_first_blocks_data_t;
+struct Argon2_first_blocks_data_t {
+    const uint8_t* blockhash;
+    const Argon2_instance_t* instance;
+};
+
+static void FillFirstBlocksJob(void* first_blocks_data, uint32_t group) {
+    const Argon2_first_blocks_data_t* my_data = (const Argon2_first_blocks_data_t*) first_blocks_data;
+    const Argon2_instance_t* instance = my_data->instance;
+    uint8_t blockhash[2 * FIRST_BLOCKS_GROUP_LANES][PREHASH_SEED_LENGTH];
+    uint8_t* out[2 * FIRST_BLOCKS_GROUP_LANES];
+    const void* in[2 * FIRST_BLOCKS_GROUP_LANES];
+    uint32_t first = group * FIRST_BLOCKS_GROUP_LANES;
+    uint32_t count = instance->lanes - first < FIRST_BLOCKS_GROUP_LANES ? instance->lanes - first : FIRST_BLOCKS_GROUP_LANES;
+
+    // Make the first and second block in the lane as G(H0||i||0) or G(H0||i||1)
+    for (uint32_t i = 0; i < 2 * count; ++i) {
+        uint32_t lane = first + i / 2;
+        memcpy(blockhash[i], my_data->blockhash, PREHASH_SEED_LENGTH);
+        blockhash[i][PREHASH_DIGEST_LENGTH] = (uint8_t) (i % 2);
+        blockhash[i][PREHASH_DIGEST_LENGTH + 4] = (uint8_t) lane;
+        out[i] = (uint8_t*) (instance->state[lane * instance->lane_length + i % 2]);
+        in[i] = blockhash[i];
+    }
+    blake2b_long_xN(out, in, 2 * count, BLOCK_SIZE, PREHASH_SEED_LENGTH);
+    secure_wipe_memory(blockhash, sizeof (blockhash));
+}
 
-        blockhash[PREHASH_DIGEST_LENGTH] = 1;
-        blake2b_long((uint8_t*) (instance->state[l * instance->lane_length + 1]), blockhash, BLOCK_SIZE, PREHASH_SEED_LENGTH);
+void FillFirstBlocks(uint8_t* blockhash, const Argon2_instance_t* instance) {
+    Argon2_first_blocks_data_t first_blocks_data = {blockhash, instance};
+    uint32_t groups = (instance->lanes + FIRST_BLOCKS_GROUP_LANES - 1) / FIRST_BLOCKS_GROUP_LANES;
+    if (instance->thread_pool != NULL && groups > 1) {
+        RunInParallel(instance->thread_pool, FillFirstBlocksJob, &first_blocks_data, groups);
+    } else {
+        // Not worth a thread per group
+        for (uint32_t g = 0; g < groups; ++g) {
+            FillFirstBlocksJob(&first_blocks_data, g);
+        }
     }
 }
 
@@ -379,26 +679,87 @@ void InitialHash(uint8_t* blockhash, Argon2_Context* context, enum Argon2_type t
     blake2b_final(&BlakeHash, blockhash, PREHASH_DIGEST_LENGTH);
 }
 
+#ifdef ARGON2_STATS
+uint64_t StatsClock(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + (uint64_t) now.tv_nsec;
+}
+
+/* Clears the statistics of the instance, keeping its arrays */
+static void ResetStats(const Argon2_instance_t* instance) {
+    Argon2_Stats* stats = instance->stats;
+    if (stats == NULL) {
+        return;
+    }
+    uint64_t* pass_ns = stats->pass_ns;
+    uint64_t* segment_ns = stats->segment_ns;
+    memset(stats, 0, sizeof (Argon2_Stats));
+    stats->pass_ns = pass_ns;
+    stats->segment_ns = segment_ns;
+    if (pass_ns != NULL) {
+        memset(pass_ns, 0, (size_t) instance->passes * sizeof (uint64_t));
+    }
+    if (segment_ns != NULL) {
+        memset(segment_ns, 0, (size_t) instance->passes * SYNC_POINTS * instance->lanes * sizeof (uint64_t));
+    }
+}
+#endif
+
 int Initialize(Argon2_instance_t* instance, Argon2_Context* context) {
     if (instance == NULL || context == NULL)
         return ARGON2_INCORRECT_PARAMETER;
+#ifdef ARGON2_STATS
+    ResetStats(instance);
+#endif
+    STATS_START(instance->stats, allocate_start);
+
     // 1. Memory allocation
     int result = ARGON2_OK;
-    if (NULL != context->allocate_cbk) {
-        result = context->allocate_cbk((uint8_t **)&(instance->state), instance->memory_blocks * BLOCK_SIZE);
+    if (NULL != context->arena) {
+        if (context->arena->memory_blocks < instance->memory_blocks) {
+            return ARGON2_ARENA_TOO_SMALL;
+        }
+        // The previous call may still be wiping the memory, and another call may be using it
+        result = ArenaAcquire(context->arena);
+        if (ARGON2_OK != result) {
+            return result;
+        }
+        instance->state = context->arena->memory;
+        if (Argon2_ds == instance->type) {
+            instance->Sbox_memory = context->arena->Sbox;
+        }
     } else {
-        result = AllocateMemory(&(instance->state), instance->memory_blocks);
+        if (Argon2_ds == instance->type) {
+            instance->Sbox_memory = AllocateSbox();
+            if (instance->Sbox_memory == NULL) {
+                return ARGON2_MEMORY_ALLOCATION_ERROR;
+            }
+        }
+        if (NULL != context->allocate_cbk) {
+            result = context->allocate_cbk((uint8_t **)&(instance->state), (size_t) instance->memory_blocks * sizeof (block));
+        } else {
+            result = AllocateMemory(&(instance->state), instance->memory_blocks);
+        }
+        if (ARGON2_OK != result) {
+            FreeSbox(instance->Sbox_memory);
+            instance->Sbox_memory = NULL;
+        }
     }
 
     if (ARGON2_OK != result) {
         return result;
     }
+    instance->Sbox = instance->Sbox_memory;
+    STATS_ADD(instance->stats, allocate_ns, allocate_start);
 
     // 2. Initial hashing
     // H_0 + 8 extra bytes to produce the first blocks
     uint8_t blockhash[PREHASH_SEED_LENGTH];
     // Hashing all inputs
+    STATS_START(instance->stats, hash_start);
     InitialHash(blockhash, context, instance->type);
+    STATS_ADD(instance->stats, initial_hash_ns, hash_start);
     // Zeroing 8 extra bytes
     secure_wipe_memory(blockhash + PREHASH_DIGEST_LENGTH, PREHASH_SEED_LENGTH - PREHASH_DIGEST_LENGTH);
 
@@ -407,23 +768,16 @@ int Initialize(Argon2_instance_t* instance, Argon2_Context* context) {
 #endif
 
     // 3. Creating first blocks, we always have at least two blocks in a slice
+    STATS_START(instance->stats, first_blocks_start);
     FillFirstBlocks(blockhash, instance);
+    STATS_ADD(instance->stats, first_blocks_ns, first_blocks_start);
     // Clearing the hash
     secure_wipe_memory(blockhash,  PREHASH_SEED_LENGTH);
 
     return ARGON2_OK;
 }
 
-int Argon2Core(Argon2_Context* context, enum Argon2_type type) {
-    /* 1. Validate all inputs */
-    int result = ValidateInputs(context);
-    if (ARGON2_OK != result) {
-        return result;
-    }
-    if (type > MAX_ARGON2_TYPE)
-        return ARGON2_INCORRECT_TYPE;
-
-    /* 2. Align memory size */
+Argon2_instance_t NewInstance(const Argon2_Context* context, enum Argon2_type type) {
     // Minimum memory_blocks = 8L blocks, where L is the number of lanes
     uint32_t memory_blocks = context->m_cost;
     if (memory_blocks < 2 * SYNC_POINTS * context->lanes) {
@@ -438,10 +792,28 @@ int Argon2Core(Argon2_Context* context, enum Argon2_type type) {
         .passes = context->t_cost,
         .memory_blocks = memory_blocks,
         .lanes = context->lanes,
+        .thread_pool = context->thread_pool,
+        .stats = context->stats,
+        .core = CurrentCore(),
 
         .segment_length = memory_blocks / (context->lanes * SYNC_POINTS),
         .lane_length = memory_blocks / context->lanes
     };
+    return instance;
+}
+
+int Argon2Core(Argon2_Context* context, enum Argon2_type type) {
+    /* 1. Validate all inputs */
+    int result = ValidateInputs(context);
+    if (ARGON2_OK != result) {
+        return result;
+    }
+    if (type >= MAX_ARGON2_TYPE) {
+        return ARGON2_INCORRECT_TYPE;
+    }
+
+    /* 2. Align memory size */
+    Argon2_instance_t instance = NewInstance(context, type);
 
     /* 3. Initialization: Hashing inputs, allocating memory, filling first blocks */
     result = Initialize(&instance, context);
@@ -14,6 +14,9 @@
 #define __ARGON2_CORE_H__
 
 #include <string.h>
+#include <pthread.h>
+
+#include "argon2-thread.h"
 
 /*************************Argon2 internal constants**************************************************/
 
@@ -32,20 +35,16 @@ enum { ADDRESSES_IN_BLOCK = (BLOCK_SIZE * sizeof (uint8_t) / sizeof (uint64_t))
 enum { PREHASH_DIGEST_LENGTH = 64 };
 enum { PREHASH_SEED_LENGTH = PREHASH_DIGEST_LENGTH + 8 };
 
-/* Argon2 primitive type */
-enum Argon2_type {
-    Argon2_d=0,
-    Argon2_i=1,
-    Argon2_di=2,
-    Argon2_id=3,
-    Argon2_ds=4,
-    MAX_ARGON2_TYPE /* Do NOT remove; Do NOT other types after this one */
-};
-
-
 /*****SM-related constants******/
 enum { SBOX_SIZE = 1 << 10 };
 enum { SBOX_MASK = SBOX_SIZE / 2 - 1 };
+/* Steps of the S-box chain per block, and per BLAKE2 round of the block */
+enum { SBOX_STEPS = 6 * 16 };
+enum { SBOX_STEPS_PER_ROUND = SBOX_STEPS / 16 };
+/* The Sbox starts on a cache line */
+enum { SBOX_ALIGNMENT = 64 };
+/* Sboxes per instance: the one of the current pass and the one generated for the next pass */
+enum { SBOX_BUFFERS = 2 };
 
 
 /*************************Argon2 internal data types**************************************************/
@@ -64,6 +63,29 @@ typedef uint64_t block[WORDS_IN_BLOCK];
  */
 void XORBlocks(uint64_t *out, const uint64_t *a, const uint64_t *b);
 
+/*
+ * Runs @a steps steps of the Argon2ds S-box chain. The chain does not depend on the BLAKE2 rounds of the block,
+ * so FillBlock() and the optimized kernels run SBOX_STEPS_PER_ROUND steps after each of the 16 rounds to overlap both
+ * @param x Current value of the chain
+ * @param Sbox Pointer to the Sbox
+ * @param steps Number of steps
+ * @return New value of the chain
+ */
+static inline uint64_t SboxSteps(uint64_t x, const uint64_t* Sbox, unsigned steps) {
+    for (unsigned i = 0; i < steps; ++i) {
+        uint32_t x1 = x >> 32;
+        uint32_t x2 = x & 0xFFFFFFFF;
+        uint64_t y = Sbox[(x1 & SBOX_MASK)];
+        uint64_t z = Sbox[(x2 & SBOX_MASK) + SBOX_SIZE / 2];
+        x = (uint64_t) x1 * (uint64_t) x2;
+        x += y;
+        x ^= z;
+    }
+    return x;
+}
+
+typedef struct Argon2_core_t Argon2_core_t;
+
 /*
  * Argon2 instance: memory pointer, number of passes, amount of memory, type, and derived values. 
  * Used to evaluate the number and location of blocks to construct in each thread
@@ -77,7 +99,25 @@ struct Argon2_instance_t {
     const uint32_t lane_length;
     const uint8_t lanes;
     const enum Argon2_type type;
-    uint64_t *Sbox; //S-boxes for Argon2_ds
+    uint64_t *Sbox; //S-box of the current pass for Argon2_ds
+    uint64_t *Sbox_memory; //SBOX_BUFFERS S-boxes, Sbox points to one of them
+    Argon2_ThreadPool* thread_pool; //Workers filling the lanes (can be NULL)
+    Argon2_Stats* stats; //Timing statistics (can be NULL)
+    const Argon2_core_t* core; //Implementation filling the blocks
+};
+
+/*
+ * Argon2 arena: memory owned by the caller and reused by consecutive calls
+ */
+struct Argon2_Arena {
+    block* memory;
+    uint32_t memory_blocks; //Number of blocks the memory can hold
+    uint64_t* Sbox; //SBOX_BUFFERS S-boxes for Argon2_ds
+    pthread_mutex_t lock;
+    pthread_cond_t released; //signalled when a deferred wipe of the memory is finished
+    bool wiping; //a deferred wipe is queued or running, the memory cannot be used yet
+    Argon2_ThreadPool* wipe_pool; //pool the deferred wipe is queued on
+    bool in_use; //a call holds the memory, from Initialize() to ReleaseMemory()
 };
 
 /*
@@ -91,6 +131,76 @@ struct Argon2_position_t {
     uint32_t index;
 };
 
+/*
+ * Argon2 reference area: the values IndexAlpha() derives from the pass, slice and lane, computed once per segment
+ * by InitReferenceArea() so that mapping a block to its reference is branch-free arithmetic
+ */
+typedef struct Argon2_reference_area_t Argon2_reference_area_t;
+struct Argon2_reference_area_t {
+    uint32_t base_size; //Reference area size in the other lanes, except for the first block of the segment
+    uint32_t start_position; //Position in the lane where the reference area starts
+    uint32_t lane_length;
+    uint32_t lanes;
+    uint64_t lanes_reciprocal; //2^64 / lanes rounded up, for the lane modulus
+    bool same_lane_only; //First slice of the first pass: the other lanes can not be referenced yet
+};
+
+/*
+ * Argon2 core implementation: the functions that construct memory blocks, one table per implementation (reference, SSE, AVX2, AVX-512).
+ * The generic functions FillSegment(), GenerateAddresses() and GenerateSbox() call the ones of @a instance->core
+ */
+struct Argon2_core_t {
+    const char* name;
+    void (*fill_segment)(const Argon2_instance_t* instance, Argon2_position_t position);
+    void (*generate_addresses)(uint64_t* input_block, uint64_t* address_block);
+    void (*generate_sbox)(const uint64_t* first_block, uint64_t* Sbox);
+};
+
+/* Reference implementation, available everywhere */
+extern const Argon2_core_t Argon2_ref_core;
+
+/*
+ * Returns the optimized implementation
+ * @param impl One of ARGON2_IMPL_SSE, ARGON2_IMPL_AVX2, ARGON2_IMPL_AVX512 on x86, ARGON2_IMPL_NEON on ARM
+ * @return Pointer to the implementation, NULL if it is not built or the CPU does not support it
+ */
+const Argon2_core_t* GetOptCore(enum Argon2_impl impl);
+
+/*
+ * Selects the implementation used by the following calls
+ * @param impl Implementation, ARGON2_IMPL_AUTO picks the fastest one supported by the CPU
+ * @return ARGON2_OK if successful, ARGON2_IMPL_NOT_SUPPORTED if @a impl is not available
+ */
+int SelectCore(enum Argon2_impl impl);
+
+/*
+ * Returns the selected implementation, the fastest supported one if SelectCore() has not been called
+ */
+const Argon2_core_t* CurrentCore(void);
+
+/*************************Argon2 timing statistics**************************************************/
+
+/*
+ * Timing of the phases into Argon2_Stats, compiled only with ARGON2_STATS. The macros are statements:
+ * STATS_START(stats, start) declares the start time @a start, STATS_ADD(stats, field, start) adds the time since then to
+ * @a stats->field, and STATS_ADD_ENTRY(stats, array, index, start) to @a stats->array[index] if the array is set.
+ * Nothing is timed if @a stats is NULL
+ */
+#ifdef ARGON2_STATS
+/* Returns a monotonic time in nanoseconds */
+uint64_t StatsClock(void);
+
+#define STATS_START(stats, start) uint64_t start = ((stats) != NULL) ? StatsClock() : 0
+#define STATS_ADD(stats, field, start) \
+    do { if ((stats) != NULL) { (stats)->field += StatsClock() - (start); } } while (0)
+#define STATS_ADD_ENTRY(stats, array, index, start) \
+    do { if ((stats) != NULL && (stats)->array != NULL) { (stats)->array[index] += StatsClock() - (start); } } while (0)
+#else
+#define STATS_START(stats, start) do { } while (0)
+#define STATS_ADD(stats, field, start) do { } while (0)
+#define STATS_ADD_ENTRY(stats, array, index, start) do { } while (0)
+#endif
+
 /*************************Argon2 core functions**************************************************/
 
 /* Allocates memory to the given pointer
@@ -100,20 +210,67 @@ struct Argon2_position_t {
  */
 int AllocateMemory(block **memory, uint32_t m_cost);
 
-/* Deallocates memory
- * @param instance pointer to the current instance
- * @param clear_memory indicates if we clear the memory with zeros.
+/* Allocates the Sboxes of an instance, aligned to SBOX_ALIGNMENT bytes
+ * @return Pointer to SBOX_BUFFERS * SBOX_SIZE words, NULL if the allocation failed
+ */
+uint64_t* AllocateSbox(void);
+
+/* Deallocates an Sbox allocated by AllocateSbox()
+ * @param Sbox Pointer to the Sbox, can be NULL
+ */
+void FreeSbox(uint64_t* Sbox);
+
+/* Clears the memory with zeros, in a way the compiler cannot remove
+ * @param v Pointer to the memory
+ * @param n Memory size in bytes
+ */
+void secure_wipe_memory(void *v, size_t n);
+
+/* Clears the memory with zeros as secure_wipe_memory(), in chunks of WIPE_CHUNK_BYTES split among the workers of @a pool
+ * @param pool Pointer to the worker pool, if NULL the memory is wiped by the calling thread
+ * @param v Pointer to the memory
+ * @param n Memory size in bytes
+ */
+void WipeMemory(Argon2_ThreadPool* pool, void *v, size_t n);
+
+/*
+ * Queues the deferred wipe @a job(@a arg, 0) of the arena memory with SubmitUrgentJob(); the memory cannot be used
+ * until the job calls ArenaEndWipe()
+ * @return ARGON2_OK if the wipe is queued, otherwise the error of SubmitUrgentJob() and the memory is left as it is
+ */
+int ArenaDeferWipe(Argon2_Arena* arena, Argon2_ThreadPool* pool, Argon2_job_t job, void* arg);
+
+/* Marks the end of a deferred wipe of the arena memory and wakes up the calls waiting for it */
+void ArenaEndWipe(Argon2_Arena* arena);
+
+/* Waits until no deferred wipe of the arena memory is queued or running, running a queued one in the calling thread */
+void ArenaWaitWipe(Argon2_Arena* arena);
+
+/*
+ * Takes the arena memory for a call, once any deferred wipe of it is finished
+ * @return ARGON2_OK, or ARGON2_ARENA_BUSY if another call holds it
  */
-void FreeMemory(Argon2_instance_t* instance, bool clear_memory);
+int ArenaAcquire(Argon2_Arena* arena);
+
+/* Gives the arena memory back after ArenaAcquire(); a deferred wipe is marked with ArenaBeginWipe() first */
+void ArenaRelease(Argon2_Arena* arena);
 
 /*
- * Generate pseudo-random values to reference blocks in the segment and puts them into the array
+ * Prepares the input block of the address generator of a segment (pass, lane, slice, parameters and the counter set to 0)
  * @param instance Pointer to the current instance
  * @param position Pointer to the current position
- * @param pseudo_rands Pointer to the array of 64-bit values
- * @pre pseudo_rands must point to @a instance->segment_length allocated values
+ * @param input_block Block to initialize
  */
-void GenerateAddresses(const Argon2_instance_t* instance, const Argon2_position_t* position, uint64_t* pseudo_rands);
+void InitAddressInput(const Argon2_instance_t* instance, const Argon2_position_t* position, uint64_t* input_block);
+
+/*
+ * Generates the next ADDRESSES_IN_BLOCK pseudo-random values to reference blocks in the segment. Called by FillSegment()
+ * every ADDRESSES_IN_BLOCK blocks, so only one block of addresses is kept at a time
+ * @param instance Pointer to the current instance
+ * @param input_block Input block prepared by InitAddressInput(), its counter is incremented
+ * @param address_block Block receiving the pseudo-random values
+ */
+void GenerateAddresses(const Argon2_instance_t* instance, uint64_t* input_block, uint64_t* address_block);
 
 /*
  * Computes absolute position of reference block in the lane following a skewed distribution and using a pseudo-random value as input
@@ -125,6 +282,47 @@ void GenerateAddresses(const Argon2_instance_t* instance, const Argon2_position_
  */
 uint32_t IndexAlpha(const Argon2_instance_t* instance, const Argon2_position_t* position, uint32_t pseudo_rand, bool same_lane);
 
+/*
+ * Computes the reference area of the segment at @a position, for ReferenceLane() and ReferenceIndex()
+ * @param instance Pointer to the current instance
+ * @param position Pointer to the current position (the index is not used)
+ * @param area Reference area to fill
+ */
+void InitReferenceArea(const Argon2_instance_t* instance, const Argon2_position_t* position, Argon2_reference_area_t* area);
+
+/*
+ * Computes the lane of the reference block, (pseudo_rand >> 32) mod lanes, with multiplications by the reciprocal
+ * (Lemire's fastmod, the 128-bit product split into 64-bit ones as lanes < 2^32)
+ * @param area Reference area of the segment
+ * @param pseudo_rand Pseudo-random value of the block
+ * @param lane Lane of the segment
+ */
+static inline uint32_t ReferenceLane(const Argon2_reference_area_t* area, uint64_t pseudo_rand, uint32_t lane) {
+    uint64_t lowbits = area->lanes_reciprocal * (pseudo_rand >> 32);
+    uint32_t ref_lane = (uint32_t) (((lowbits >> 32) * area->lanes + (((lowbits & 0xFFFFFFFF) * area->lanes) >> 32)) >> 32);
+    return area->same_lane_only ? lane : ref_lane;
+}
+
+/*
+ * Computes the position of the reference block in its lane, as IndexAlpha()
+ * @param area Reference area of the segment
+ * @param index Index of the block in the segment
+ * @param pseudo_rand 32-bit pseudo-random value used to determine the position
+ * @param same_lane Indicates if the block will be taken from the current lane
+ */
+static inline uint32_t ReferenceIndex(const Argon2_reference_area_t* area, uint32_t index, uint32_t pseudo_rand, bool same_lane) {
+    // The current lane adds the blocks of this segment but the previous one; the other lanes lose their last block at index 0
+    uint32_t reference_area_size = area->base_size + (same_lane ? index - 1 : 0 - (uint32_t) (index == 0));
+
+    uint64_t relative_position = pseudo_rand;
+    relative_position = relative_position * relative_position >> 32;
+    relative_position = reference_area_size - 1 - (reference_area_size * relative_position >> 32);
+
+    // The area is shorter than the lane, so the position wraps at most once
+    uint32_t absolute_position = area->start_position + (uint32_t) relative_position;
+    return (absolute_position >= area->lane_length) ? absolute_position - area->lane_length : absolute_position;
+}
+
 /*
  * Function that validates all inputs against predefined restrictions and return an error code
  * @param context Pointer to current Argon2 context
@@ -142,7 +340,7 @@ int ValidateInputs(const Argon2_Context* context);
 void InitialHash(uint8_t* blockhash, Argon2_Context* context, enum Argon2_type type);
 
 /*
- * Function creates first 2 blocks per lane
+ * Function creates first 2 blocks per lane, one job per lane on @a instance->thread_pool if it is not NULL
  * @param instance Pointer to the current instance
  * @param blockhash Pointer to the pre-hashing digest
  * @pre blockhash must point to @a PREHASH_SEED_LENGTH allocated values
@@ -161,6 +359,7 @@ int Initialize(Argon2_instance_t* instance, Argon2_Context* context);
 
 /*
  * XORing the last block of each lane, hashing it, making the tag. Deallocates the memory.
+ * With @a instance->thread_pool the last blocks are XORed in groups of lanes in parallel, then the groups are combined.
  * @param context Pointer to current Argon2 context (use only the out parameters from it)
  * @param instance Pointer to current instance of Argon2
  * @pre instance->state must point to necessary amount of memory
@@ -169,6 +368,14 @@ int Initialize(Argon2_instance_t* instance, Argon2_Context* context);
  */
 void Finalize(const Argon2_Context *context, Argon2_instance_t* instance);
 
+/*
+ * Deallocates the memory of the instance as Finalize() does (wiping it if @a context->clear_memory is set),
+ * or keeps it in the arena
+ * @param context Pointer to current Argon2 context
+ * @param instance Pointer to current instance of Argon2
+ */
+void ReleaseMemory(const Argon2_Context *context, Argon2_instance_t* instance);
+
 
 /*
  * Function fills a new memory block
@@ -189,11 +396,31 @@ void FillBlock(const uint64_t *prev_block, const uint64_t *ref_block, uint64_t *
 void FillSegment(const Argon2_instance_t* instance, Argon2_position_t position);
 
 /*
- * Function that fills the entire memory t_cost times based on the first two blocks in each lane
+ * Function that fills the entire memory t_cost times based on the first two blocks in each lane.
+ * The segments of one slice are filled in parallel, one job per lane on @a instance->thread_pool (or one thread per lane if it is NULL),
+ * and all of them are finished at each synchronization point
  * @param instance Pointer to the current instance
  */
 void FillMemoryBlocks(Argon2_instance_t* instance);
 
+/*
+ * Fills the segments of one slice of all lanes, in parallel as FillMemoryBlocks() does, and returns at the synchronization point.
+ * The slices must be filled in order: FillMemoryBlocks() is FillSlice() for every slice of every pass
+ * @param instance Pointer to the current instance
+ * @param pass Pass of the slice
+ * @param slice Slice, less than SYNC_POINTS
+ */
+void FillSlice(Argon2_instance_t* instance, uint32_t pass, uint8_t slice);
+
+/*
+ * Computes the (rounded) memory size and the lane and segment lengths of the instance for a validated context.
+ * The memory is not allocated yet
+ * @param context Pointer to current Argon2 context, validated by ValidateInputs()
+ * @param type Argon2 type
+ * @return The instance
+ */
+Argon2_instance_t NewInstance(const Argon2_Context* context, enum Argon2_type type);
+
 
 /*
  * Function that performs memory-hard hashing with certain degree of parallelism
@@ -205,7 +432,8 @@ int Argon2Core(Argon2_Context* context, enum Argon2_type type);
 /*
  * Generates the Sbox from the first memory block (must be ready at that time)
  * @param instance Pointer to the current instance 
+ * @param Sbox Pointer to the SBOX_SIZE words to fill
  */
-void GenerateSbox(Argon2_instance_t* instance);
+void GenerateSbox(const Argon2_instance_t* instance, uint64_t* Sbox);
 
 #endif
@@ -8,9 +8,28 @@
  */
 
 
+#include <stdlib.h>
 #include <stdint.h>
 
 
+#include "argon2.h"
+#include "argon2-core.h"
+#include "kat.h"
+
+
+/*
+ * The optimized core is built on x86, with the SSE, AVX2 and AVX-512 kernels, and on ARM, with the NEON kernel;
+ * elsewhere GetOptCore() reports it as unsupported
+ */
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define HAVE_X86_KERNELS
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define HAVE_NEON_KERNEL
+#endif
+
+
+#if defined(HAVE_X86_KERNELS)
+
 #if !defined(_MSC_VER)
 #include <x86intrin.h>
 #else 
@@ -20,22 +39,70 @@
 #endif
 
 
-#include "argon2.h"
-#include "argon2-core.h"
-#include "kat.h"
+#include "blake2-round-mka.h"
+#include "blake2-round-mka-avx2.h"
+#include "blake2-round-mka-avx512.h"
+
+
+/* Kernels are compiled for their instruction set whatever the flags of this file, and picked at runtime */
+#if defined(__GNUC__) && (defined(__clang__) || __GNUC__ >= 5)
+#define HAVE_WIDE_KERNELS
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define TARGET_SSE41
+#define ALWAYS_INLINE inline
+#endif
 
+/* 128-bit part of the state of a kernel */
+typedef __m128i vector128_t;
+#define PREFETCH_LINE(address) _mm_prefetch((address), _MM_HINT_T0)
+#define STORE_FENCE() _mm_sfence()
+
+#elif defined(HAVE_NEON_KERNEL)
+
+#include <arm_neon.h>
+
+#include "blake2-round-mka-neon.h"
+
+#if defined(__GNUC__)
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+#define PREFETCH_LINE(address) __builtin_prefetch((address))
+#else
+#define ALWAYS_INLINE inline
+#define PREFETCH_LINE(address) ((void) (address))
+#endif
+
+typedef uint64x2_t vector128_t;
+/* The NEON kernel has no non-temporal stores */
+#define STORE_FENCE() ((void) 0)
+
+#endif
+
+
+#if defined(HAVE_X86_KERNELS) || defined(HAVE_NEON_KERNEL)
 
-#include "blake2-round-mka.h"
 #include "blake2-impl.h"
 #include "blake2.h"
 
 
-#if defined(KAT) || defined(KAT_INTERNAL)
-/* The KAT file name */
-const char* KAT_FILENAME = "kat-argon2-opt.log";
+/* Number of blocks ahead whose reference block is prefetched in the data-independent segments, 0 disables prefetching */
+#ifndef ARGON2_PREFETCH_DISTANCE
+#define ARGON2_PREFETCH_DISTANCE 2
 #endif
 
 
+/*
+* Memory size in bytes from which new blocks are written with non-temporal stores, 0 (the default) disables them.
+* They save the read for ownership of each new block, but most references go to recent blocks, which they evict:
+* on the CPUs tested they are slower even at 4 GiB
+*/
+#ifndef ARGON2_NONTEMPORAL_THRESHOLD
+#define ARGON2_NONTEMPORAL_THRESHOLD 0
+#endif
+
 
 /*
 * Function fills a new memory block
@@ -43,9 +110,17 @@ const char* KAT_FILENAME = "kat-argon2-opt.log";
 * @param ref_block Pointer to the reference block
 * @param next_block Pointer to the block to be constructed
 * @param Sbox Pointer to the Sbox (used in Argon2_ds only)
+* @param nontemporal Whether @a next_block is written around the caches; the caller must issue STORE_FENCE() before the block is read by another thread
 * @pre all block pointers must be valid
 */
-void FillBlockOpt(__m128i* state, const uint64_t *ref_block, uint64_t *next_block, const uint64_t* Sbox) {
+typedef void (*FillBlockOpt_t)(vector128_t* state, const uint64_t *ref_block, uint64_t *next_block, const uint64_t* Sbox, bool nontemporal);
+
+#if defined(HAVE_X86_KERNELS)
+/*
+* SSE kernel: 64 128-bit registers, one BLAKE2 round per 8 of them.
+* Its block does not fit in the 16 registers anyway, and it is faster called than inlined into the segment loops
+*/
+TARGET_SSE41 static void FillBlockSSE(__m128i* state, const uint64_t *ref_block, uint64_t *next_block, const uint64_t* Sbox, bool nontemporal) {
     __m128i block_XY[QWORDS_IN_BLOCK];
     __m128i t0, t1;
      __m128i r16 = _mm_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
@@ -53,204 +128,491 @@ void FillBlockOpt(__m128i* state, const uint64_t *ref_block, uint64_t *next_bloc
 
 
     for (uint8_t i = 0; i < QWORDS_IN_BLOCK; i++) {
-        block_XY[i] = _mm_load_si128((__m128i *) ref_block);
-        ref_block += 2;
-    }
-    for (uint8_t i = 0; i < QWORDS_IN_BLOCK; i++) {
-        block_XY[i] = state[i] = _mm_xor_si128(state[i], block_XY[i]);
+        block_XY[i] = state[i] = _mm_xor_si128(state[i], _mm_load_si128((const __m128i *) ref_block + i));
     }
 
     uint64_t x = 0;
     if (Sbox != NULL) {
         x = _mm_extract_epi64(block_XY[0], 0) ^ _mm_extract_epi64(block_XY[QWORDS_IN_BLOCK - 1],1);
-        for (int i = 0; i < 6 * 16; ++i) {
-            uint32_t x1 = x >> 32;
-            uint32_t x2 = x & 0xFFFFFFFF;
-            uint64_t y = Sbox[(x1 & SBOX_MASK)];
-            uint64_t z = Sbox[(x2 & SBOX_MASK) + SBOX_SIZE / 2];
-            x = (uint64_t) x1 * (uint64_t) x2;
-            x += y;
-            x ^= z;
+    }
+
+    // The S-box chain runs in the shadow of the rounds, SBOX_STEPS_PER_ROUND steps per round
+    for (uint8_t i = 0; i < 8; i++) {
+        BLAKE2_ROUND(state[8 * i], state[8 * i + 1], state[8 * i + 2], state[8 * i + 3],
+                state[8 * i + 4], state[8 * i + 5], state[8 * i + 6], state[8 * i + 7]);
+        if (Sbox != NULL) {
+            x = SboxSteps(x, Sbox, SBOX_STEPS_PER_ROUND);
         }
     }
 
-    BLAKE2_ROUND(state[0], state[1], state[2], state[3],
-            state[4], state[5], state[6], state[7]);
+    for (uint8_t i = 0; i < 8; i++) {
+        BLAKE2_ROUND(state[i], state[i + 8], state[i + 16], state[i + 24],
+                state[i + 32], state[i + 40], state[i + 48], state[i + 56]);
+        if (Sbox != NULL) {
+            x = SboxSteps(x, Sbox, SBOX_STEPS_PER_ROUND);
+        }
+    }
 
-    BLAKE2_ROUND(state[8], state[9], state[10], state[11],
-            state[12], state[13], state[14], state[15]);
+    for (uint8_t i = 0; i < QWORDS_IN_BLOCK; i++) {
+        // Feedback
+        state[i] = _mm_xor_si128(state[i], block_XY[i]);
+    }
+    state[0] = _mm_add_epi64(state[0], _mm_set_epi64x(0, x));
+    state[QWORDS_IN_BLOCK - 1] = _mm_add_epi64(state[QWORDS_IN_BLOCK - 1], _mm_set_epi64x(x, 0));
+    if (nontemporal) {
+        for (uint8_t i = 0; i < QWORDS_IN_BLOCK; i++) {
+            _mm_stream_si128((__m128i *) next_block + i, state[i]);
+        }
+    } else {
+        for (uint8_t i = 0; i < QWORDS_IN_BLOCK; i++) {
+            _mm_store_si128((__m128i *) next_block + i, state[i]);
+        }
+    }
+}
+
+#ifdef HAVE_WIDE_KERNELS
+/*
+* AVX2 kernel: the block is held in 32 256-bit registers S[k] = words 4k..4k+3.
+* Rows are BLAKE2 rounds on (S[4i], S[4i+1], S[4i+2], S[4i+3]); columns are gathered two at a time from 128-bit halves
+*/
+TARGET_AVX2 static ALWAYS_INLINE void FillBlockAVX2(__m128i* state128, const uint64_t *ref_block, uint64_t *next_block, const uint64_t* Sbox, bool nontemporal) {
+    __m256i state[32];
+    __m256i block_XY[32];
+    const __m256i r16 = _mm256_setr_epi8(2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9,
+            2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9);
+    const __m256i r24 = _mm256_setr_epi8(3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10,
+            3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10);
+
+    for (uint8_t i = 0; i < 32; i++) {
+        block_XY[i] = state[i] = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *) state128 + i),
+                _mm256_loadu_si256((const __m256i *) ref_block + i));
+    }
+
+    uint64_t x = 0;
+    if (Sbox != NULL) {
+        x = _mm256_extract_epi64(block_XY[0], 0) ^ _mm256_extract_epi64(block_XY[31], 3);
+    }
+
+    // The S-box chain runs in the shadow of the rounds, SBOX_STEPS_PER_ROUND steps per round
+    for (uint8_t i = 0; i < 8; i++) {
+        BLAKE2_ROUND_AVX2(state[4 * i], state[4 * i + 1], state[4 * i + 2], state[4 * i + 3]);
+        if (Sbox != NULL) {
+            x = SboxSteps(x, Sbox, SBOX_STEPS_PER_ROUND);
+        }
+    }
 
-    BLAKE2_ROUND(state[16], state[17], state[18], state[19],
-            state[20], state[21], state[22], state[23]);
+    for (uint8_t j = 0; j < 4; j++) {
+        // Columns 2j and 2j+1: words (2j, 2j+1), (2j+16, 2j+17), ... are the halves of state[j], state[j+4], ...
+        __m256i A0 = _mm256_permute2x128_si256(state[j], state[j + 4], 0x20);
+        __m256i A1 = _mm256_permute2x128_si256(state[j], state[j + 4], 0x31);
+        __m256i B0 = _mm256_permute2x128_si256(state[j + 8], state[j + 12], 0x20);
+        __m256i B1 = _mm256_permute2x128_si256(state[j + 8], state[j + 12], 0x31);
+        __m256i C0 = _mm256_permute2x128_si256(state[j + 16], state[j + 20], 0x20);
+        __m256i C1 = _mm256_permute2x128_si256(state[j + 16], state[j + 20], 0x31);
+        __m256i D0 = _mm256_permute2x128_si256(state[j + 24], state[j + 28], 0x20);
+        __m256i D1 = _mm256_permute2x128_si256(state[j + 24], state[j + 28], 0x31);
+
+        BLAKE2_ROUND_AVX2(A0, B0, C0, D0);
+        BLAKE2_ROUND_AVX2(A1, B1, C1, D1);
+        if (Sbox != NULL) {
+            x = SboxSteps(x, Sbox, 2 * SBOX_STEPS_PER_ROUND);
+        }
+
+        state[j] = _mm256_permute2x128_si256(A0, A1, 0x20);
+        state[j + 4] = _mm256_permute2x128_si256(A0, A1, 0x31);
+        state[j + 8] = _mm256_permute2x128_si256(B0, B1, 0x20);
+        state[j + 12] = _mm256_permute2x128_si256(B0, B1, 0x31);
+        state[j + 16] = _mm256_permute2x128_si256(C0, C1, 0x20);
+        state[j + 20] = _mm256_permute2x128_si256(C0, C1, 0x31);
+        state[j + 24] = _mm256_permute2x128_si256(D0, D1, 0x20);
+        state[j + 28] = _mm256_permute2x128_si256(D0, D1, 0x31);
+    }
 
-    BLAKE2_ROUND(state[24], state[25], state[26], state[27],
-            state[28], state[29], state[30], state[31]);
+    for (uint8_t i = 0; i < 32; i++) {
+        // Feedback
+        state[i] = _mm256_xor_si256(state[i], block_XY[i]);
+    }
+    state[0] = _mm256_add_epi64(state[0], _mm256_set_epi64x(0, 0, 0, x));
+    state[31] = _mm256_add_epi64(state[31], _mm256_set_epi64x(x, 0, 0, 0));
+    for (uint8_t i = 0; i < 32; i++) {
+        _mm256_storeu_si256((__m256i *) state128 + i, state[i]);
+    }
+    if (nontemporal) {
+        // Blocks are only 16-byte aligned by malloc()
+        for (uint8_t i = 0; i < 32; i++) {
+            _mm_stream_si128((__m128i *) next_block + 2 * i, _mm256_castsi256_si128(state[i]));
+            _mm_stream_si128((__m128i *) next_block + 2 * i + 1, _mm256_extracti128_si256(state[i], 1));
+        }
+    } else {
+        for (uint8_t i = 0; i < 32; i++) {
+            _mm256_storeu_si256((__m256i *) next_block + i, state[i]);
+        }
+    }
+}
 
-    BLAKE2_ROUND(state[32], state[33], state[34], state[35],
-            state[36], state[37], state[38], state[39]);
+/*
+* AVX-512 kernel: the block is held in 16 512-bit registers Z[k] = words 8k..8k+7.
+* Two rows or two pairs of columns are gathered into the halves of one register set and processed together,
+* so the full vector width is used on a single block. Interleaving two independent blocks (two lanes, or two hashes of a batch)
+* in one call does not pay off: the rounds are already limited by the vector units, and the second block doubles the working set
+*/
+TARGET_AVX512 static ALWAYS_INLINE void FillBlockAVX512(__m128i* state128, const uint64_t *ref_block, uint64_t *next_block, const uint64_t* Sbox, bool nontemporal) {
+    __m512i state[16];
+    __m512i block_XY[16];
 
-    BLAKE2_ROUND(state[40], state[41], state[42], state[43],
-            state[44], state[45], state[46], state[47]);
+    for (uint8_t i = 0; i < 16; i++) {
+        block_XY[i] = state[i] = _mm512_xor_si512(_mm512_loadu_si512((const __m512i *) state128 + i),
+                _mm512_loadu_si512((const __m512i *) ref_block + i));
+    }
 
-    BLAKE2_ROUND(state[48], state[49], state[50], state[51],
-            state[52], state[53], state[54], state[55]);
+    uint64_t x = 0;
+    if (Sbox != NULL) {
+        x = _mm_cvtsi128_si64(_mm512_castsi512_si128(block_XY[0])) ^
+                _mm_extract_epi64(_mm512_extracti32x4_epi32(block_XY[15], 3), 1);
+    }
 
-    BLAKE2_ROUND(state[56], state[57], state[58], state[59],
-            state[60], state[61], state[62], state[63]);
+    for (uint8_t i = 0; i < 8; i += 2) {
+        // Rows i and i+1: row i is (A|B) = state[2i], (C|D) = state[2i+1]
+        __m512i A = _mm512_shuffle_i64x2(state[2 * i], state[2 * i + 2], _MM_SHUFFLE(1, 0, 1, 0));
+        __m512i B = _mm512_shuffle_i64x2(state[2 * i], state[2 * i + 2], _MM_SHUFFLE(3, 2, 3, 2));
+        __m512i C = _mm512_shuffle_i64x2(state[2 * i + 1], state[2 * i + 3], _MM_SHUFFLE(1, 0, 1, 0));
+        __m512i D = _mm512_shuffle_i64x2(state[2 * i + 1], state[2 * i + 3], _MM_SHUFFLE(3, 2, 3, 2));
+
+        BLAKE2_ROUND_AVX512(A, B, C, D);
+        // The S-box chain runs in the shadow of the rounds, SBOX_STEPS_PER_ROUND steps per round
+        if (Sbox != NULL) {
+            x = SboxSteps(x, Sbox, 2 * SBOX_STEPS_PER_ROUND);
+        }
 
+        state[2 * i] = _mm512_shuffle_i64x2(A, B, _MM_SHUFFLE(1, 0, 1, 0));
+        state[2 * i + 2] = _mm512_shuffle_i64x2(A, B, _MM_SHUFFLE(3, 2, 3, 2));
+        state[2 * i + 1] = _mm512_shuffle_i64x2(C, D, _MM_SHUFFLE(1, 0, 1, 0));
+        state[2 * i + 3] = _mm512_shuffle_i64x2(C, D, _MM_SHUFFLE(3, 2, 3, 2));
+    }
 
-    BLAKE2_ROUND(state[0], state[8], state[16], state[24],
-            state[32], state[40], state[48], state[56]);
+    // Columns 4j+l and 4j+l+1 (l = 0, 2) take the 128-bit lanes l, l+1 of state[j + 2k] for k = 0..7
+    const __m512i gather_lo = _mm512_set_epi64(11, 10, 3, 2, 9, 8, 1, 0);
+    const __m512i gather_hi = _mm512_set_epi64(15, 14, 7, 6, 13, 12, 5, 4);
+    const __m512i scatter_lo = _mm512_set_epi64(13, 12, 9, 8, 5, 4, 1, 0);
+    const __m512i scatter_hi = _mm512_set_epi64(15, 14, 11, 10, 7, 6, 3, 2);
+    for (uint8_t j = 0; j < 2; j++) {
+        __m512i A0 = _mm512_permutex2var_epi64(state[j], gather_lo, state[j + 2]);
+        __m512i A1 = _mm512_permutex2var_epi64(state[j], gather_hi, state[j + 2]);
+        __m512i B0 = _mm512_permutex2var_epi64(state[j + 4], gather_lo, state[j + 6]);
+        __m512i B1 = _mm512_permutex2var_epi64(state[j + 4], gather_hi, state[j + 6]);
+        __m512i C0 = _mm512_permutex2var_epi64(state[j + 8], gather_lo, state[j + 10]);
+        __m512i C1 = _mm512_permutex2var_epi64(state[j + 8], gather_hi, state[j + 10]);
+        __m512i D0 = _mm512_permutex2var_epi64(state[j + 12], gather_lo, state[j + 14]);
+        __m512i D1 = _mm512_permutex2var_epi64(state[j + 12], gather_hi, state[j + 14]);
+
+        BLAKE2_ROUND_AVX512(A0, B0, C0, D0);
+        BLAKE2_ROUND_AVX512(A1, B1, C1, D1);
+        if (Sbox != NULL) {
+            x = SboxSteps(x, Sbox, 4 * SBOX_STEPS_PER_ROUND);
+        }
 
-    BLAKE2_ROUND(state[1], state[9], state[17], state[25],
-            state[33], state[41], state[49], state[57]);
+        state[j] = _mm512_permutex2var_epi64(A0, scatter_lo, A1);
+        state[j + 2] = _mm512_permutex2var_epi64(A0, scatter_hi, A1);
+        state[j + 4] = _mm512_permutex2var_epi64(B0, scatter_lo, B1);
+        state[j + 6] = _mm512_permutex2var_epi64(B0, scatter_hi, B1);
+        state[j + 8] = _mm512_permutex2var_epi64(C0, scatter_lo, C1);
+        state[j + 10] = _mm512_permutex2var_epi64(C0, scatter_hi, C1);
+        state[j + 12] = _mm512_permutex2var_epi64(D0, scatter_lo, D1);
+        state[j + 14] = _mm512_permutex2var_epi64(D0, scatter_hi, D1);
+    }
 
-    BLAKE2_ROUND(state[2], state[10], state[18], state[26],
-            state[34], state[42], state[50], state[58])
+    for (uint8_t i = 0; i < 16; i++) {
+        // Feedback
+        state[i] = _mm512_xor_si512(state[i], block_XY[i]);
+    }
+    state[0] = _mm512_add_epi64(state[0], _mm512_set_epi64(0, 0, 0, 0, 0, 0, 0, x));
+    state[15] = _mm512_add_epi64(state[15], _mm512_set_epi64(x, 0, 0, 0, 0, 0, 0, 0));
+    for (uint8_t i = 0; i < 16; i++) {
+        _mm512_storeu_si512((__m512i *) state128 + i, state[i]);
+    }
+    if (nontemporal) {
+        // Blocks are only 16-byte aligned by malloc()
+        for (uint8_t i = 0; i < 16; i++) {
+            _mm_stream_si128((__m128i *) next_block + 4 * i, _mm512_castsi512_si128(state[i]));
+            _mm_stream_si128((__m128i *) next_block + 4 * i + 1, _mm512_extracti32x4_epi32(state[i], 1));
+            _mm_stream_si128((__m128i *) next_block + 4 * i + 2, _mm512_extracti32x4_epi32(state[i], 2));
+            _mm_stream_si128((__m128i *) next_block + 4 * i + 3, _mm512_extracti32x4_epi32(state[i], 3));
+        }
+    } else {
+        for (uint8_t i = 0; i < 16; i++) {
+            _mm512_storeu_si512((__m512i *) next_block + i, state[i]);
+        }
+    }
+}
+#endif
+#endif
 
-            BLAKE2_ROUND(state[3], state[11], state[19], state[27],
-            state[35], state[43], state[51], state[59]);
+#if defined(HAVE_NEON_KERNEL)
+/*
+* NEON kernel: the SSE one with uint64x2_t, 64 registers, one BLAKE2 round per 8 of them.
+* There is no non-temporal store intrinsic, so @a nontemporal is ignored
+*/
+static void FillBlockNEON(uint64x2_t* state, const uint64_t *ref_block, uint64_t *next_block, const uint64_t* Sbox, bool nontemporal) {
+    uint64x2_t block_XY[QWORDS_IN_BLOCK];
+    uint64x2_t t0, t1;
+    (void) nontemporal;
 
-    BLAKE2_ROUND(state[4], state[12], state[20], state[28],
-            state[36], state[44], state[52], state[60]);
+    for (uint8_t i = 0; i < QWORDS_IN_BLOCK; i++) {
+        block_XY[i] = state[i] = veorq_u64(state[i], vld1q_u64(ref_block + 2 * i));
+    }
 
-    BLAKE2_ROUND(state[5], state[13], state[21], state[29],
-            state[37], state[45], state[53], state[61]);
+    uint64_t x = 0;
+    if (Sbox != NULL) {
+        x = vgetq_lane_u64(block_XY[0], 0) ^ vgetq_lane_u64(block_XY[QWORDS_IN_BLOCK - 1], 1);
+    }
 
-    BLAKE2_ROUND(state[6], state[14], state[22], state[30],
-            state[38], state[46], state[54], state[62]);
+    // The S-box chain runs in the shadow of the rounds, SBOX_STEPS_PER_ROUND steps per round
+    for (uint8_t i = 0; i < 8; i++) {
+        BLAKE2_ROUND_NEON(state[8 * i], state[8 * i + 1], state[8 * i + 2], state[8 * i + 3],
+                state[8 * i + 4], state[8 * i + 5], state[8 * i + 6], state[8 * i + 7]);
+        if (Sbox != NULL) {
+            x = SboxSteps(x, Sbox, SBOX_STEPS_PER_ROUND);
+        }
+    }
 
-    BLAKE2_ROUND(state[7], state[15], state[23], state[31],
-            state[39], state[47], state[55], state[63]);
+    for (uint8_t i = 0; i < 8; i++) {
+        BLAKE2_ROUND_NEON(state[i], state[i + 8], state[i + 16], state[i + 24],
+                state[i + 32], state[i + 40], state[i + 48], state[i + 56]);
+        if (Sbox != NULL) {
+            x = SboxSteps(x, Sbox, SBOX_STEPS_PER_ROUND);
+        }
+    }
 
     for (uint8_t i = 0; i < QWORDS_IN_BLOCK; i++) {
         // Feedback
-        state[i] = _mm_xor_si128(state[i], block_XY[i]);
+        state[i] = veorq_u64(state[i], block_XY[i]);
     }
-    state[0] = _mm_add_epi64(state[0], _mm_set_epi64x(0, x));
-    state[QWORDS_IN_BLOCK - 1] = _mm_add_epi64(state[QWORDS_IN_BLOCK - 1], _mm_set_epi64x(x, 0));
+    state[0] = vaddq_u64(state[0], vcombine_u64(vcreate_u64(x), vcreate_u64(0)));
+    state[QWORDS_IN_BLOCK - 1] = vaddq_u64(state[QWORDS_IN_BLOCK - 1], vcombine_u64(vcreate_u64(0), vcreate_u64(x)));
     for (uint8_t i = 0; i < QWORDS_IN_BLOCK; i++) {
-        _mm_store_si128((__m128i *) next_block, state[i]);
-        next_block += 2;
+        vst1q_u64(next_block + 2 * i, state[i]);
     }
 }
+#endif
 
-void GenerateAddresses(const Argon2_instance_t* instance, const Argon2_position_t* position, uint64_t* pseudo_rands) {
+/*
+* Generates the next block of pseudo-random values, as GenerateAddresses(), with the given kernel
+*/
+static ALWAYS_INLINE void GenerateAddressesKernel(FillBlockOpt_t FillBlockOpt, uint64_t* input_block, uint64_t* address_block) {
     block zero_block, zero2_block;
-    block input_block;
-    block address_block;
-    memset(input_block, 0, sizeof(block));
-    memset(address_block, 0, sizeof(block));
-    if (instance != NULL && position != NULL) {
-        input_block[0] = position->pass;
-        input_block[1] = position->lane;
-        input_block[2] = position->slice;
-        input_block[3] = instance->memory_blocks;
-        input_block[4] = instance->passes;
-        input_block[5] = instance->type;
-
-        for (uint32_t i = 0; i < instance->segment_length; ++i) {
-            if (i % ADDRESSES_IN_BLOCK == 0) {
-                input_block[6]++;
-                memset(zero_block, 0, sizeof(block));
-                memset(zero2_block, 0, sizeof(block));
-                FillBlockOpt((__m128i *)zero_block, input_block, address_block, NULL);
-                FillBlockOpt((__m128i *)zero2_block, address_block, address_block, NULL);
-            }
-            pseudo_rands[i] = address_block[i % ADDRESSES_IN_BLOCK];
-        }
-    }
+    memset(zero_block, 0, sizeof(block));
+    memset(zero2_block, 0, sizeof(block));
+    input_block[6]++;
+    FillBlockOpt((vector128_t *)zero_block, input_block, address_block, NULL, false);
+    FillBlockOpt((vector128_t *)zero2_block, address_block, address_block, NULL, false);
 }
 
-
+/*
+* Prefetches the reference block of a block of a data-independent segment into the cache
+* @param instance Pointer to the current instance
+* @param area Reference area of the segment
+* @param lane Lane of the segment
+* @param index Index of the block whose reference is prefetched
+* @param pseudo_rand Pseudo-random value of that block
+*/
+static inline void PrefetchReference(const Argon2_instance_t* instance, const Argon2_reference_area_t* area, uint32_t lane, uint32_t index, uint64_t pseudo_rand) {
+    uint32_t ref_lane = ReferenceLane(area, pseudo_rand, lane);
+    uint32_t ref_index = ReferenceIndex(area, index, pseudo_rand & 0xFFFFFFFF, ref_lane == lane);
+    const char* ref_block = (const char*) instance->state[instance->lane_length * ref_lane + ref_index];
+    for (unsigned i = 0; i < BLOCK_SIZE; i += 64) {
+        PREFETCH_LINE(ref_block + i);
+    }
+}
 
 /*
-* Function that fills the segment using previous segments also from other threads. Identical to the reference code except that it calls optimized FillBlockOpt()
+* Function that fills the segment using previous segments also from other threads. Identical to the reference code except that it calls
+* the optimized kernel FillBlockOpt(), and that it is inlined into one loop per addressing mode: with constant @a data_independent_addressing
+* and @a Sbox (NULL or known not to be), the loop has no test of the mode left
+* @param FillBlockOpt Kernel
 * @param instance Pointer to the current instance
 * @param position Current position
+* @param data_independent_addressing Whether the reference blocks come from the address generator rather than the previous block
+* @param Sbox Pointer to the Sbox in Argon2_ds, otherwise NULL
 * @pre all block pointers must be valid
 */
-void FillSegment(const Argon2_instance_t* instance, Argon2_position_t position) {
+static ALWAYS_INLINE void FillSegmentKernel(FillBlockOpt_t FillBlockOpt, const Argon2_instance_t* instance, Argon2_position_t position,
+        const bool data_independent_addressing, const uint64_t* Sbox) {
     uint64_t pseudo_rand, ref_index, ref_lane;
     uint32_t prev_offset, curr_offset;
-    __m128i state[64];
-    bool data_independent_addressing = (instance->type == Argon2_i) || (instance->type == Argon2_id && (position.pass == 0) && (position.slice < SYNC_POINTS / 2));
+    vector128_t state[64];
     if (instance != NULL) {
-        // Pseudo-random values that determine the reference block position
-        uint64_t *pseudo_rands = malloc(instance->segment_length * sizeof(uint64_t));
-        if (pseudo_rands != NULL) {
-            if (data_independent_addressing) {
-                GenerateAddresses(instance, &position, pseudo_rands);
-            }
-
-            uint32_t starting_index = 0;
-            if ((0 == position.pass) && (0 == position.slice)) {
-                starting_index = 2; // we have already generated the first two blocks
-            }
+        bool nontemporal = false;
+#if ARGON2_NONTEMPORAL_THRESHOLD > 0
+        nontemporal = (uint64_t) instance->memory_blocks * BLOCK_SIZE >= ARGON2_NONTEMPORAL_THRESHOLD;
+#endif
+        // Reference area of the segment, shared by all its blocks
+        Argon2_reference_area_t area;
+        InitReferenceArea(instance, &position, &area);
+
+        // Pseudo-random values that determine the reference block position, generated one block at a time
+        block input_block, address_block;
+        if (data_independent_addressing) {
+            InitAddressInput(instance, &position, input_block);
+        }
 
-            // Offset of the current block
-            curr_offset = position.lane * instance->lane_length + position.slice * instance->segment_length + starting_index;
-            if (0 == curr_offset % instance->lane_length) {
-                // Last block in this lane
-                prev_offset = curr_offset + instance->lane_length - 1;
-            } else {
-                // Previous block
-                prev_offset = curr_offset - 1;
+        uint32_t starting_index = 0;
+        if ((0 == position.pass) && (0 == position.slice)) {
+            starting_index = 2; // we have already generated the first two blocks
+            if (data_independent_addressing) {
+                GenerateAddressesKernel(FillBlockOpt, input_block, address_block); // addresses of the first block of the segment
             }
-            memmove(state, (uint8_t *) (instance->state + prev_offset), BLOCK_SIZE);
-            for (uint32_t i = starting_index; i < instance->segment_length; ++i, ++curr_offset, ++prev_offset) {
-                /*1.1 Rotating prev_offset if needed */
-                if (curr_offset % instance->lane_length == 1) {
-                    prev_offset = curr_offset - 1;
-                }
+        }
 
-                /* 1.2 Computing the index of the reference block */
-                /* 1.2.1 Taking pseudo-random value from the previous block */
-                if (data_independent_addressing) {
-                    pseudo_rand = pseudo_rands[i];
-                } else {
-                    pseudo_rand = instance->state[prev_offset][0];
+        // Offset of the current block
+        curr_offset = position.lane * instance->lane_length + position.slice * instance->segment_length + starting_index;
+        if (0 == position.slice && 0 == starting_index) {
+            // Last block in this lane
+            prev_offset = curr_offset + instance->lane_length - 1;
+        } else {
+            // Previous block
+            prev_offset = curr_offset - 1;
+        }
+        // The previous block is kept in state from then on, so the first slice needs no rotation of prev_offset
+        memmove(state, (uint8_t *) (instance->state + prev_offset), BLOCK_SIZE);
+        for (uint32_t i = starting_index; i < instance->segment_length; ++i, ++curr_offset) {
+            /* 1.2 Computing the index of the reference block */
+            /* 1.2.1 Taking pseudo-random value from the previous block */
+            if (data_independent_addressing) {
+                if (i % ADDRESSES_IN_BLOCK == 0) {
+                    GenerateAddressesKernel(FillBlockOpt, input_block, address_block);
                 }
-
-                /* 1.2.2 Computing the lane of the reference block */
-                ref_lane = ((pseudo_rand >> 32)) % instance->lanes;
-                if ((position.pass == 0) && (position.slice == 0)) {
-                    // Can not reference other lanes yet
-                    ref_lane = position.lane;
+                pseudo_rand = address_block[i % ADDRESSES_IN_BLOCK];
+#if ARGON2_PREFETCH_DISTANCE > 0
+                // The addresses of the following blocks are known already: start loading their references from memory
+                uint32_t ahead = i + ARGON2_PREFETCH_DISTANCE;
+                if (ahead < instance->segment_length && ahead / ADDRESSES_IN_BLOCK == i / ADDRESSES_IN_BLOCK) {
+                    PrefetchReference(instance, &area, position.lane, ahead, address_block[ahead % ADDRESSES_IN_BLOCK]);
                 }
+#endif
+            } else {
+                // The previous block is in state: its copy in memory may still be in flight
+                memcpy(&pseudo_rand, state, sizeof(pseudo_rand));
+            }
 
-                /* 1.2.3 Computing the number of possible reference block within the lane. */
-                position.index = i;
-                ref_index = IndexAlpha(instance, &position, pseudo_rand & 0xFFFFFFFF, ref_lane == position.lane);
+            /* 1.2.2 Computing the lane of the reference block */
+            ref_lane = ReferenceLane(&area, pseudo_rand, position.lane);
 
-                /* 2 Creating a new block */
-                uint64_t *ref_block = instance->state[instance->lane_length * ref_lane + ref_index];
-                uint64_t *curr_block = instance->state[curr_offset];
-                FillBlockOpt(state, ref_block, curr_block, instance->Sbox);
-            }
+            /* 1.2.3 Computing the number of possible reference block within the lane. */
+            ref_index = ReferenceIndex(&area, i, pseudo_rand & 0xFFFFFFFF, ref_lane == position.lane);
 
-            free(pseudo_rands);
+            /* 2 Creating a new block */
+            uint64_t *ref_block = instance->state[instance->lane_length * ref_lane + ref_index];
+            uint64_t *curr_block = instance->state[curr_offset];
+            FillBlockOpt(state, ref_block, curr_block, Sbox, nontemporal);
+        }
+        if (nontemporal) {
+            // The other lanes read this segment after the synchronization point
+            STORE_FENCE();
         }
     }
 }
 
-void GenerateSbox(Argon2_instance_t* instance) {
+/*
+* Generates the Sbox, as GenerateSbox(), with the given kernel
+*/
+static ALWAYS_INLINE void GenerateSboxKernel(FillBlockOpt_t FillBlockOpt, const uint64_t* first_block, uint64_t* Sbox) {
     block zero_block, zero2_block;
     block start_block;
     block out_block;
-    memmove(start_block, instance->state[0], sizeof(block));
+    memmove(start_block, first_block, sizeof(block));
     memset(out_block, 0, sizeof(block));
 
-    if (instance == NULL)
-        return;
-    if (instance->Sbox == NULL)
-        instance->Sbox = malloc(SBOX_SIZE * sizeof(uint64_t));
-
     for (uint32_t i = 0; i < SBOX_SIZE / WORDS_IN_BLOCK; ++i) {
         memset(zero_block, 0, sizeof(block));
         memset(zero2_block, 0, sizeof(block));
-        FillBlockOpt((__m128i*)zero_block, start_block, out_block, NULL);
-        FillBlockOpt((__m128i*)zero2_block, out_block, start_block,NULL);
-        memmove(instance->Sbox + i*WORDS_IN_BLOCK, start_block, BLOCK_SIZE);
+        FillBlockOpt((vector128_t*)zero_block, start_block, out_block, NULL, false);
+        FillBlockOpt((vector128_t*)zero2_block, out_block, start_block, NULL, false);
+        memmove(Sbox + i*WORDS_IN_BLOCK, start_block, BLOCK_SIZE);
+    }
+}
+
+
+/*
+* Defines the dispatch table Argon2_<name>_core of the optimized core with the given kernel, with the functions inlining it
+* compiled for its instruction set @a target.
+* The segment is filled by one of three loops picked once per segment: data-dependent (Argon2d, Argon2di, the second half of Argon2id),
+* data-independent (Argon2i, the first half of Argon2id) and data-dependent with the S-box (Argon2ds)
+*/
+#define OPT_CORE(name, kernel, target) \
+    target static void FillSegmentDependent##name(const Argon2_instance_t* instance, Argon2_position_t position) { \
+        FillSegmentKernel(kernel, instance, position, false, NULL); \
+    } \
+    target static void FillSegmentIndependent##name(const Argon2_instance_t* instance, Argon2_position_t position) { \
+        FillSegmentKernel(kernel, instance, position, true, NULL); \
+    } \
+    target static void FillSegmentSbox##name(const Argon2_instance_t* instance, Argon2_position_t position) { \
+        FillSegmentKernel(kernel, instance, position, false, instance->Sbox); \
+    } \
+    static void FillSegment##name(const Argon2_instance_t* instance, Argon2_position_t position) { \
+        if (instance->type == Argon2_ds) { \
+            FillSegmentSbox##name(instance, position); \
+        } else if ((instance->type == Argon2_i) || (instance->type == Argon2_id && (position.pass == 0) && (position.slice < SYNC_POINTS / 2))) { \
+            FillSegmentIndependent##name(instance, position); \
+        } else { \
+            FillSegmentDependent##name(instance, position); \
+        } \
+    } \
+    target static void GenerateAddresses##name(uint64_t* input_block, uint64_t* address_block) { \
+        GenerateAddressesKernel(kernel, input_block, address_block); \
+    } \
+    target static void GenerateSbox##name(const uint64_t* first_block, uint64_t* Sbox) { \
+        GenerateSboxKernel(kernel, first_block, Sbox); \
+    } \
+    static const Argon2_core_t Argon2_##name##_core = { \
+        #name, FillSegment##name, GenerateAddresses##name, GenerateSbox##name \
+    };
+
+#endif
+
+
+#if defined(HAVE_X86_KERNELS)
+
+// No instruction set for the SSE loops: they call the kernel rather than inline it
+OPT_CORE(sse, FillBlockSSE, )
+#ifdef HAVE_WIDE_KERNELS
+OPT_CORE(avx2, FillBlockAVX2, TARGET_AVX2)
+OPT_CORE(avx512, FillBlockAVX512, TARGET_AVX512)
+#endif
+
+const Argon2_core_t* GetOptCore(enum Argon2_impl impl) {
+#ifdef HAVE_WIDE_KERNELS
+    __builtin_cpu_init();
+    switch (impl) {
+        case ARGON2_IMPL_SSE:
+            return __builtin_cpu_supports("sse4.1") ? &Argon2_sse_core : NULL;
+        case ARGON2_IMPL_AVX2:
+            return __builtin_cpu_supports("avx2") ? &Argon2_avx2_core : NULL;
+        case ARGON2_IMPL_AVX512:
+            return __builtin_cpu_supports("avx512f") ? &Argon2_avx512_core : NULL;
+        default:
+            return NULL;
     }
+#else
+    return (impl == ARGON2_IMPL_SSE) ? &Argon2_sse_core : NULL;
+#endif
+}
+
+
+#elif defined(HAVE_NEON_KERNEL)
+
+// NEON is part of the base AArch64 and ARMv7 targets it is compiled for, so it needs no runtime check
+OPT_CORE(neon, FillBlockNEON, )
+
+const Argon2_core_t* GetOptCore(enum Argon2_impl impl) {
+    return (impl == ARGON2_IMPL_NEON) ? &Argon2_neon_core : NULL;
+}
+
+
+#else /* neither x86 nor ARM */
+
+const Argon2_core_t* GetOptCore(enum Argon2_impl impl) {
+    (void) impl;
+    return NULL;
 }
+
+#endif
@@ -22,12 +22,6 @@
 #include "blake2.h"
 
 
-#if defined(KAT) || defined(KAT_INTERNAL)
-/* The KAT file name */
-const char* KAT_FILENAME = "kat-argon2-ref.log";
-#endif
-
-
 void FillBlock(const block prev_block, const block ref_block, block next_block, const uint64_t* Sbox) {
     block blockR;
     block block_tmp;
@@ -37,15 +31,6 @@ void FillBlock(const block prev_block, const block ref_block, block next_block,
     uint64_t x = 0;
     if (Sbox != NULL) {
         x = blockR[0] ^ blockR[WORDS_IN_BLOCK - 1];
-        for (int i = 0; i < 6 * 16; ++i) {
-            uint32_t x1 = x >> 32;
-            uint32_t x2 = x & 0xFFFFFFFF;
-            uint64_t y = Sbox[(x1 & SBOX_MASK)];
-            uint64_t z = Sbox[(x2 & SBOX_MASK) + SBOX_SIZE / 2];
-            x = (uint64_t) x1 * (uint64_t) x2;
-            x += y;
-            x ^= z;
-        }
     }
 
 
@@ -55,6 +40,9 @@ void FillBlock(const block prev_block, const block ref_block, block next_block,
                 blockR[16 * i + 4], blockR[16 * i + 5], blockR[16 * i + 6], blockR[16 * i + 7],
                 blockR[16 * i + 8], blockR[16 * i + 9], blockR[16 * i + 10], blockR[16 * i + 11],
                 blockR[16 * i + 12], blockR[16 * i + 13], blockR[16 * i + 14], blockR[16 * i + 15]);
+        if (Sbox != NULL) {
+            x = SboxSteps(x, Sbox, SBOX_STEPS_PER_ROUND);
+        }
     }
     // Apply Blake2 on rows of 64-bit words: (0,1,16,17,...112,113), then (2,3,18,19,...,114,115).. finally (14,15,30,31,...,126,127)
     for (unsigned i = 0; i < 8; i++) {
@@ -62,6 +50,9 @@ void FillBlock(const block prev_block, const block ref_block, block next_block,
                 blockR[2 * i + 32], blockR[2 * i + 33], blockR[2 * i + 48], blockR[2 * i + 49],
                 blockR[2 * i + 64], blockR[2 * i + 65], blockR[2 * i + 80], blockR[2 * i + 81],
                 blockR[2 * i + 96], blockR[2 * i + 97], blockR[2 * i + 112], blockR[2 * i + 113]);
+        if (Sbox != NULL) {
+            x = SboxSteps(x, Sbox, SBOX_STEPS_PER_ROUND);
+        }
     }
 
     XORBlocks(next_block, blockR, block_tmp);
@@ -69,106 +60,91 @@ void FillBlock(const block prev_block, const block ref_block, block next_block,
     next_block[WORDS_IN_BLOCK - 1] += x;
 }
 
-void GenerateAddresses(const Argon2_instance_t* instance, const Argon2_position_t* position, uint64_t* pseudo_rands) {
+static void GenerateAddressesRef(uint64_t* input_block, uint64_t* address_block) {
     static block zero_block;
-    block input_block = {0};
-    block address_block = {0};
-    if (instance != NULL && position != NULL) {
-        input_block[0] = position->pass;
-        input_block[1] = position->lane;
-        input_block[2] = position->slice;
-        input_block[3] = instance->memory_blocks;
-        input_block[4] = instance->passes;
-        input_block[5] = instance->type;
-
-        for (uint32_t i = 0; i < instance->segment_length; ++i) {
-            if (i % ADDRESSES_IN_BLOCK == 0) {
-                input_block[6]++;
-                FillBlock(zero_block, input_block, address_block, NULL);
-                FillBlock(zero_block, address_block, address_block, NULL);
-            }
-            pseudo_rands[i] = address_block[i % ADDRESSES_IN_BLOCK];
-        }
-    }
+    input_block[6]++;
+    FillBlock(zero_block, input_block, address_block, NULL);
+    FillBlock(zero_block, address_block, address_block, NULL);
 }
 
-void FillSegment(const Argon2_instance_t* instance, Argon2_position_t position) {
+static void FillSegmentRef(const Argon2_instance_t* instance, Argon2_position_t position) {
     uint64_t pseudo_rand, ref_index, ref_lane;
     uint32_t prev_offset, curr_offset;
     bool data_independent_addressing = (instance->type == Argon2_i) || (instance->type == Argon2_id && (position.pass == 0) && (position.slice < SYNC_POINTS / 2));
     if (instance != NULL) {
-        // Pseudo-random values that determine the reference block position
-        uint64_t *pseudo_rands = malloc(instance->segment_length * sizeof(uint64_t));
-        if (pseudo_rands != NULL) {
+        // Reference area of the segment, shared by all its blocks
+        Argon2_reference_area_t area;
+        InitReferenceArea(instance, &position, &area);
+
+        // Pseudo-random values that determine the reference block position, generated one block at a time
+        block input_block, address_block;
+        if (data_independent_addressing) {
+            InitAddressInput(instance, &position, input_block);
+        }
+
+        uint32_t starting_index = 0;
+        if ((0 == position.pass) && (0 == position.slice)) {
+            starting_index = 2; // we have already generated the first two blocks
             if (data_independent_addressing) {
-                GenerateAddresses(instance, &position, pseudo_rands);
+                GenerateAddressesRef(input_block, address_block); // addresses of the first block of the segment
             }
+        }
 
-            uint32_t starting_index = 0;
-            if ((0 == position.pass) && (0 == position.slice)) {
-                starting_index = 2; // we have already generated the first two blocks
-            }
+        // Offset of the current block
+        curr_offset = position.lane * instance->lane_length + position.slice * instance->segment_length + starting_index;
+        if (0 == position.slice && 0 == starting_index) {
+            // Last block in this lane
+            prev_offset = curr_offset + instance->lane_length - 1;
+        } else {
+            // Previous block
+            prev_offset = curr_offset - 1;
+        }
 
-            // Offset of the current block
-            curr_offset = position.lane * instance->lane_length + position.slice * instance->segment_length + starting_index;
-            if (0 == curr_offset % instance->lane_length) {
-                // Last block in this lane
-                prev_offset = curr_offset + instance->lane_length - 1;
-            } else {
-                // Previous block
+        for (uint32_t i = starting_index; i < instance->segment_length; ++i, ++curr_offset, ++prev_offset) {
+            /*1.1 Rotating prev_offset if needed */
+            if (0 == position.slice && 1 == i) {
                 prev_offset = curr_offset - 1;
             }
 
-            for (uint32_t i = starting_index; i < instance->segment_length; ++i, ++curr_offset, ++prev_offset) {
-                /*1.1 Rotating prev_offset if needed */
-                if (curr_offset % instance->lane_length == 1) {
-                    prev_offset = curr_offset - 1;
-                }
-
-                /* 1.2 Computing the index of the reference block */
-                /* 1.2.1 Taking pseudo-random value from the previous block */
-                if (data_independent_addressing) {
-                    pseudo_rand = pseudo_rands[i];
-                } else {
-                    pseudo_rand = instance->state[prev_offset][0];
-                }
-
-                /* 1.2.2 Computing the lane of the reference block */
-                ref_lane = ((pseudo_rand >> 32)) % instance->lanes;
-                if ((position.pass == 0) && (position.slice == 0)) {
-                    // Can not reference other lanes yet
-                    ref_lane = position.lane;
+            /* 1.2 Computing the index of the reference block */
+            /* 1.2.1 Taking pseudo-random value from the previous block */
+            if (data_independent_addressing) {
+                if (i % ADDRESSES_IN_BLOCK == 0) {
+                    GenerateAddressesRef(input_block, address_block);
                 }
+                pseudo_rand = address_block[i % ADDRESSES_IN_BLOCK];
+            } else {
+                pseudo_rand = instance->state[prev_offset][0];
+            }
 
-                /* 1.2.3 Computing the number of possible reference block within the lane. */
-                position.index = i;
-                ref_index = IndexAlpha(instance, &position, pseudo_rand & 0xFFFFFFFF, ref_lane == position.lane);
+            /* 1.2.2 Computing the lane of the reference block */
+            ref_lane = ReferenceLane(&area, pseudo_rand, position.lane);
 
-                /* 2 Creating a new block */
-                uint64_t* ref_block = instance->state[instance->lane_length * ref_lane + ref_index];
-                uint64_t* curr_block = instance->state[curr_offset];
-                uint64_t* prev_block = instance->state[prev_offset];
-                FillBlock(prev_block, ref_block, curr_block, instance->Sbox);
-            }
+            /* 1.2.3 Computing the number of possible reference block within the lane. */
+            ref_index = ReferenceIndex(&area, i, pseudo_rand & 0xFFFFFFFF, ref_lane == position.lane);
 
-            free(pseudo_rands);
+            /* 2 Creating a new block */
+            uint64_t* ref_block = instance->state[instance->lane_length * ref_lane + ref_index];
+            uint64_t* curr_block = instance->state[curr_offset];
+            uint64_t* prev_block = instance->state[prev_offset];
+            FillBlock(prev_block, ref_block, curr_block, instance->Sbox);
         }
     }
 }
 
-void GenerateSbox(Argon2_instance_t* instance) {
+static void GenerateSboxRef(const uint64_t* first_block, uint64_t* Sbox) {
     static block zero_block;
     block start_block;
     block out_block = {0};
-    memmove(start_block, instance->state[0], sizeof(block));
-    if (instance == NULL)
-        return;
-    if (instance->Sbox == NULL)
-        instance->Sbox = malloc(SBOX_SIZE * sizeof(uint64_t));
+    memmove(start_block, first_block, sizeof(block));
 
     for (uint32_t i = 0; i < SBOX_SIZE / WORDS_IN_BLOCK; ++i) {
         FillBlock(zero_block, start_block, out_block, NULL);
         FillBlock(zero_block, out_block, start_block, NULL);
-        memmove(instance->Sbox + i*WORDS_IN_BLOCK, start_block, BLOCK_SIZE);
+        memmove(Sbox + i*WORDS_IN_BLOCK, start_block, BLOCK_SIZE);
     }
 }
+
+const Argon2_core_t Argon2_ref_core = {
+    "ref", FillSegmentRef, GenerateAddressesRef, GenerateSboxRef
+};
@@ -0,0 +1,353 @@
+/*
+ * Argon2 source code package
+ *
+ * This work is licensed under a Creative Commons CC0 1.0 License/Waiver.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+
+/*For CPU affinity*/
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#if defined(__linux__)
+#include <sched.h>
+#include <unistd.h>
+#endif
+
+#include "argon2.h"
+#include "argon2-thread.h"
+
+
+/*
+ * A call to RunInParallel: jobs are claimed one by one, by the workers and by the calling thread
+ */
+typedef struct Argon2_task_t Argon2_task_t;
+struct Argon2_task_t {
+    Argon2_job_t job;
+    void* arg;
+    uint32_t count; //number of jobs
+    uint32_t next; //next job to be claimed
+    uint32_t finished; //number of finished jobs
+    bool detached; //queued by SubmitJob(): nobody waits for it, the worker that runs it frees it
+    bool urgent; //queued by SubmitUrgentJob(): ahead of the other tasks and outside the queue limit
+    Argon2_task_t* next_task; //next task in the queue
+};
+
+struct Argon2_ThreadPool {
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready; //signalled when a task is queued or the pool shuts down
+    pthread_cond_t work_done; //signalled when the last job of a task is finished
+    Argon2_task_t* head; //tasks with unclaimed jobs
+    Argon2_task_t* tail;
+    bool shutdown;
+    uint32_t submitted; //jobs queued by SubmitJob() and not finished yet, urgent ones excepted
+    uint32_t queue_limit; //maximum number of submitted jobs, 0 if unlimited
+    uint32_t threads;
+    pthread_t* workers;
+};
+
+/* Removes a task whose jobs are all claimed from the queue. Must be called with the lock held */
+static void UnlinkTask(Argon2_ThreadPool* pool, Argon2_task_t* task) {
+    Argon2_task_t* prev = NULL;
+    for (Argon2_task_t* t = pool->head; t != NULL; prev = t, t = t->next_task) {
+        if (t == task) {
+            if (prev == NULL) {
+                pool->head = t->next_task;
+            } else {
+                prev->next_task = t->next_task;
+            }
+            if (pool->tail == t) {
+                pool->tail = prev;
+            }
+            return;
+        }
+    }
+}
+
+/* Claims the next job of the task. Must be called with the lock held */
+static uint32_t ClaimJob(Argon2_ThreadPool* pool, Argon2_task_t* task) {
+    uint32_t index = task->next++;
+    if (task->next == task->count) {
+        UnlinkTask(pool, task);
+    }
+    return index;
+}
+
+/* Runs a claimed job and accounts for it. Must be called with the lock held, which is released during the job */
+static void RunJob(Argon2_ThreadPool* pool, Argon2_task_t* task, uint32_t index) {
+    pthread_mutex_unlock(&pool->lock);
+    task->job(task->arg, index);
+    pthread_mutex_lock(&pool->lock);
+    if (++task->finished == task->count) {
+        pthread_cond_broadcast(&pool->work_done);
+    }
+}
+
+static void* WorkerThr(void* pool_ptr) {
+    Argon2_ThreadPool* pool = (Argon2_ThreadPool*) pool_ptr;
+
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->shutdown && pool->head == NULL) {
+            pthread_cond_wait(&pool->work_ready, &pool->lock);
+        }
+        if (pool->head == NULL) {
+            break; // shutdown and no work left
+        }
+        Argon2_task_t* task = pool->head;
+        RunJob(pool, task, ClaimJob(pool, task));
+        if (task->detached) {
+            if (!task->urgent) {
+                --pool->submitted;
+            }
+            free(task);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/*
+ * Argon2 thread data for the pool-less mode: one job run by its own thread
+ */
+typedef struct Argon2_thread_data_t Argon2_thread_data_t;
+struct Argon2_thread_data_t {
+    Argon2_job_t job;
+    void* arg;
+    uint32_t index;
+};
+
+static void* JobThr(void* thread_data) {
+    const Argon2_thread_data_t* my_data = (const Argon2_thread_data_t*) thread_data;
+    my_data->job(my_data->arg, my_data->index);
+    return NULL;
+}
+
+static void RunInThreads(Argon2_job_t job, void* arg, uint32_t count) {
+    pthread_t thread[count];
+    bool thread_started[count];
+    Argon2_thread_data_t thr_data[count];
+
+    for (uint32_t i = 0; i < count; ++i) {
+        thr_data[i].job = job;
+        thr_data[i].arg = arg;
+        thr_data[i].index = i;
+        thread_started[i] = false;
+        if (i + 1 < count) {
+            thread_started[i] = (0 == pthread_create(&thread[i], NULL, JobThr, &thr_data[i]));
+        }
+        if (!thread_started[i]) {
+            // Last job or no thread available: run it here
+            JobThr(&thr_data[i]);
+        }
+    }
+
+    for (uint32_t i = 0; i < count; ++i) {
+        if (thread_started[i]) {
+            pthread_join(thread[i], NULL);
+        }
+    }
+}
+
+void RunInParallel(Argon2_ThreadPool* pool, Argon2_job_t job, void* arg, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1) {
+        job(arg, 0);
+        return;
+    }
+    if (pool == NULL) {
+        RunInThreads(job, arg, count);
+        return;
+    }
+
+    Argon2_task_t task = {
+        .job = job,
+        .arg = arg,
+        .count = count,
+        .next = 0,
+        .finished = 0,
+        .detached = false,
+        .urgent = false,
+        .next_task = NULL
+    };
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail != NULL) {
+        pool->tail->next_task = &task;
+    } else {
+        pool->head = &task;
+    }
+    pool->tail = &task;
+    pthread_cond_broadcast(&pool->work_ready);
+
+    // Take part in our own task, then wait for the jobs claimed by the workers
+    while (task.next < task.count) {
+        RunJob(pool, &task, ClaimJob(pool, &task));
+    }
+    while (task.finished < task.count) {
+        pthread_cond_wait(&pool->work_done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/* Queues a detached task: at the tail within the queue limit, or, if @a urgent, after the urgent tasks already queued */
+static int QueueDetachedJob(Argon2_ThreadPool* pool, Argon2_job_t job, void* arg, bool urgent) {
+    Argon2_task_t* task = malloc(sizeof (Argon2_task_t));
+    if (task == NULL) {
+        return ARGON2_MEMORY_ALLOCATION_ERROR;
+    }
+    task->job = job;
+    task->arg = arg;
+    task->count = 1;
+    task->next = 0;
+    task->finished = 0;
+    task->detached = true;
+    task->urgent = urgent;
+    task->next_task = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (urgent) {
+        Argon2_task_t* prev = NULL;
+        for (Argon2_task_t* t = pool->head; t != NULL && t->urgent; t = t->next_task) {
+            prev = t;
+        }
+        task->next_task = (prev != NULL) ? prev->next_task : pool->head;
+        if (prev != NULL) {
+            prev->next_task = task;
+        } else {
+            pool->head = task;
+        }
+        if (pool->tail == prev) {
+            pool->tail = task;
+        }
+    } else {
+        if (pool->queue_limit != 0 && pool->submitted >= pool->queue_limit) {
+            pthread_mutex_unlock(&pool->lock);
+            free(task);
+            return ARGON2_QUEUE_FULL;
+        }
+        ++pool->submitted;
+        if (pool->tail != NULL) {
+            pool->tail->next_task = task;
+        } else {
+            pool->head = task;
+        }
+        pool->tail = task;
+    }
+    pthread_cond_signal(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+    return ARGON2_OK;
+}
+
+int SubmitJob(Argon2_ThreadPool* pool, Argon2_job_t job, void* arg) {
+    return QueueDetachedJob(pool, job, arg, false);
+}
+
+int SubmitUrgentJob(Argon2_ThreadPool* pool, Argon2_job_t job, void* arg) {
+    return QueueDetachedJob(pool, job, arg, true);
+}
+
+bool RunUrgentJob(Argon2_ThreadPool* pool) {
+    pthread_mutex_lock(&pool->lock);
+    Argon2_task_t* task = pool->head;
+    bool found = task != NULL && task->urgent;
+    if (found) {
+        RunJob(pool, task, ClaimJob(pool, task));
+        free(task);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return found;
+}
+
+static void PinThread(pthread_t thread, uint32_t i) {
+#if defined(__linux__)
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus > 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(i % (uint32_t) cpus, &set);
+        pthread_setaffinity_np(thread, sizeof (set), &set); // best effort
+    }
+#else
+    (void) thread;
+    (void) i;
+#endif
+}
+
+Argon2_ThreadPool* Argon2_ThreadPoolCreate(uint32_t threads, bool pin_threads) {
+    if (threads == 0) {
+        return NULL;
+    }
+
+    Argon2_ThreadPool* pool = malloc(sizeof (Argon2_ThreadPool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pool->workers = malloc(threads * sizeof (pthread_t));
+    if (pool->workers == NULL) {
+        free(pool);
+        return NULL;
+    }
+    pool->head = NULL;
+    pool->tail = NULL;
+    pool->shutdown = false;
+    pool->submitted = 0;
+    pool->queue_limit = 0;
+    pool->threads = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->work_ready, NULL);
+    pthread_cond_init(&pool->work_done, NULL);
+
+    for (uint32_t i = 0; i < threads; ++i) {
+        if (0 != pthread_create(&pool->workers[i], NULL, WorkerThr, pool)) {
+            Argon2_ThreadPoolDestroy(pool);
+            return NULL;
+        }
+        pool->threads++;
+        if (pin_threads) {
+            PinThread(pool->workers[i], i);
+        }
+    }
+
+    return pool;
+}
+
+void Argon2_ThreadPoolSetQueueLimit(Argon2_ThreadPool* pool, uint32_t limit) {
+    if (pool == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->queue_limit = limit;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void Argon2_ThreadPoolDestroy(Argon2_ThreadPool* pool) {
+    if (pool == NULL) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->work_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (uint32_t i = 0; i < pool->threads; ++i) {
+        pthread_join(pool->workers[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->work_done);
+    pthread_cond_destroy(&pool->work_ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    free(pool);
+}
@@ -0,0 +1,69 @@
+/*
+ * Argon2 source code package
+ *
+ * This work is licensed under a Creative Commons CC0 1.0 License/Waiver.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+
+#pragma once
+
+#ifndef __ARGON2_THREAD_H__
+#define __ARGON2_THREAD_H__
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*************************Argon2 parallel jobs**************************************************/
+
+/*
+ * Job run by one thread
+ * @param arg Argument shared by all jobs of the same call
+ * @param index Index of the job, in [0, count)
+ */
+typedef void (*Argon2_job_t)(void* arg, uint32_t index);
+
+/*
+ * Runs @a job(@a arg, i) for every i in [0, @a count) in parallel and returns when all of them are finished.
+ * The calling thread takes part in the work. If @a pool is NULL, one thread per job is created (except for the last job,
+ * which is run by the calling thread), otherwise the jobs are handed to the workers of @a pool.
+ * Jobs may themselves call RunInParallel on the same pool.
+ * @param pool Pointer to the worker pool, can be NULL
+ * @param job Function to run
+ * @param arg Argument passed to each job
+ * @param count Number of jobs
+ */
+void RunInParallel(Argon2_ThreadPool* pool, Argon2_job_t job, void* arg, uint32_t count);
+
+/*
+ * Queues @a job(@a arg, 0) to be run by a worker of @a pool and returns without waiting for it.
+ * The job owns @a arg. Workers drain the queue before Argon2_ThreadPoolDestroy() returns
+ * @param pool Pointer to the worker pool
+ * @param job Function to run
+ * @param arg Argument passed to the job
+ * @return ARGON2_OK if the job is queued, ARGON2_QUEUE_FULL if the pool already has its queue limit of unfinished submitted jobs,
+ * ARGON2_MEMORY_ALLOCATION_ERROR if the job could not be queued
+ */
+int SubmitJob(Argon2_ThreadPool* pool, Argon2_job_t job, void* arg);
+
+/*
+ * Queues @a job(@a arg, 0) as SubmitJob() does, but ahead of the jobs already queued (after the urgent ones) and outside
+ * the queue limit: for short jobs that other jobs may wait for, such as a deferred wipe
+ * @param pool Pointer to the worker pool
+ * @param job Function to run
+ * @param arg Argument passed to the job
+ * @return ARGON2_OK if the job is queued, ARGON2_MEMORY_ALLOCATION_ERROR if it could not be queued
+ */
+int SubmitUrgentJob(Argon2_ThreadPool* pool, Argon2_job_t job, void* arg);
+
+/*
+ * Runs the first job queued by SubmitUrgentJob(), if it is not claimed yet, in the calling thread.
+ * A thread waiting for an urgent job calls it rather than wait for a worker, as all of them may be waiting as well
+ * @param pool Pointer to the worker pool
+ * @return true if a job was run
+ */
+bool RunUrgentJob(Argon2_ThreadPool* pool);
+
+#endif
@@ -0,0 +1,153 @@
+/*
+ * Argon2 source code package
+ *
+ * This work is licensed under a Creative Commons CC0 1.0 License/Waiver.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+
+/*For clock_gettime*/
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "argon2.h"
+#include "argon2-core.h"
+
+
+/* Runs per measurement: the fastest one is kept */
+enum { TUNE_RUNS = 2 };
+/* Attempts to find the number of passes that fits the budget once it is estimated */
+enum { TUNE_PASS_ATTEMPTS = 3 };
+/* Fewest passes of the types that use password-independent addressing, which tradeoff attacks break below it */
+enum { TUNE_MIN_INDEPENDENT_PASSES = 3 };
+/* Fraction of the budget aimed at when the memory is scaled down, as the time is not exactly linear in it */
+#define TUNE_MEMORY_MARGIN 0.9
+
+static double Milliseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+/*
+ * Measures one hash with the given parameters, including the allocation and the wipe of the memory
+ * @param ms Pointer receiving the duration of the fastest of TUNE_RUNS runs
+ * @return ARGON2_OK if successful, the error code of the hash otherwise
+ */
+static int TimeHash(enum Argon2_type type, uint32_t t_cost, uint32_t m_cost, uint32_t lanes, Argon2_ThreadPool* pool, double* ms) {
+    uint8_t out[32];
+    uint8_t pwd[16];
+    uint8_t salt[16];
+    memset(pwd, 0, sizeof (pwd));
+    memset(salt, 1, sizeof (salt));
+
+    *ms = 0;
+    for (int run = 0; run < TUNE_RUNS; ++run) {
+        Argon2_Context context = {
+            .out = out,
+            .outlen = sizeof (out),
+            .pwd = pwd,
+            .pwdlen = sizeof (pwd),
+            .salt = salt,
+            .saltlen = sizeof (salt),
+            .t_cost = t_cost,
+            .m_cost = m_cost,
+            .lanes = lanes,
+            .clear_memory = true,
+            .thread_pool = pool
+        };
+        double start = Milliseconds();
+        int result = Argon2Core(&context, type);
+        double elapsed = Milliseconds() - start;
+        if (ARGON2_OK != result) {
+            return result;
+        }
+        if (run == 0 || elapsed < *ms) {
+            *ms = elapsed;
+        }
+    }
+    return ARGON2_OK;
+}
+
+int Argon2_Tune(enum Argon2_type type, uint32_t target_ms, uint32_t max_m_cost, uint32_t lanes, Argon2_ThreadPool* pool, Argon2_Params* params) {
+    if (NULL == params || 0 == target_ms) {
+        return ARGON2_INCORRECT_PARAMETER;
+    }
+    if (type >= MAX_ARGON2_TYPE) {
+        return ARGON2_INCORRECT_TYPE;
+    }
+    if (MIN_LANES > lanes) {
+        return ARGON2_LANES_TOO_FEW;
+    }
+    if (MAX_LANES < lanes) {
+        return ARGON2_LANES_TOO_MANY;
+    }
+    uint32_t min_m_cost = 2 * SYNC_POINTS * lanes;
+    if (max_m_cost < min_m_cost) {
+        return ARGON2_MEMORY_TOO_LITTLE;
+    }
+
+    bool independent = (Argon2_i == type || Argon2_di == type || Argon2_id == type);
+    uint32_t min_t_cost = independent ? TUNE_MIN_INDEPENDENT_PASSES : 1;
+
+    // 1. Memory first, as it costs the attacker more than passes: the largest amount the fewest passes fill within the budget
+    uint32_t m_cost = max_m_cost;
+    double ms;
+    while (true) {
+        int result = TimeHash(type, min_t_cost, m_cost, lanes, pool, &ms);
+        if (ARGON2_OK != result) {
+            return result;
+        }
+        if (ms <= target_ms || m_cost == min_m_cost) {
+            break;
+        }
+        double scaled = (double) m_cost * TUNE_MEMORY_MARGIN * target_ms / ms;
+        m_cost = (scaled < min_m_cost) ? min_m_cost : (uint32_t) scaled;
+    }
+
+    // 2. Passes with the remaining time: the first pass also pays the allocation and the first and last blocks
+    uint32_t t_cost = min_t_cost;
+    double t_ms = ms;
+    if (ms < target_ms) {
+        double ms2;
+        int result = TimeHash(type, min_t_cost + 1, m_cost, lanes, pool, &ms2);
+        if (ARGON2_OK != result) {
+            return result;
+        }
+        if (ms2 <= target_ms) {
+            t_cost = min_t_cost + 1;
+            t_ms = ms2;
+            double pass_ms = (ms2 > ms) ? ms2 - ms : ms2 / t_cost;
+            double estimate = t_cost + (target_ms - ms2) / pass_ms;
+            uint32_t candidate = (estimate >= MAX_TIME) ? MAX_TIME : (uint32_t) estimate;
+            for (int attempt = 0; attempt < TUNE_PASS_ATTEMPTS && candidate > t_cost; ++attempt) {
+                double candidate_ms;
+                result = TimeHash(type, candidate, m_cost, lanes, pool, &candidate_ms);
+                if (ARGON2_OK != result) {
+                    return result;
+                }
+                if (candidate_ms <= target_ms) {
+                    t_cost = candidate;
+                    t_ms = candidate_ms;
+                    break;
+                }
+                // Over budget: retry with the passes the measured rate allows
+                candidate = t_cost + (uint32_t) ((candidate - t_cost) * (target_ms - t_ms) / (candidate_ms - t_ms));
+            }
+        }
+    }
+
+    params->t_cost = t_cost;
+    params->m_cost = m_cost;
+    params->lanes = lanes;
+    params->milliseconds = t_ms;
+    return ARGON2_OK;
+}
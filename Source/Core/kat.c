@@ -15,6 +15,11 @@
 #include "argon2-core.h"
 
 
+#if defined(KAT) || defined(KAT_INTERNAL)
+/* The KAT file name */
+const char* KAT_FILENAME = "kat-argon2.log";
+#endif
+
 
 #ifdef KAT
 
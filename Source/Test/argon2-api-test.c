@@ -0,0 +1,313 @@
+/*
+ * Argon2 source code package
+ *
+ * This work is licensed under a Creative Commons CC0 1.0 License/Waiver.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+
+/*For clock_gettime*/
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "argon2.h"
+
+
+/*
+ * API checks: corner cases of the public entry points that the test vectors do not reach.
+ * Each check writes why it failed to @a failure and returns false, or returns true
+ */
+typedef bool (*Api_check_t)(char* failure, size_t failure_length);
+
+enum { API_TAG_LENGTH = 32 };
+
+static uint8_t api_pwd[16] = {1};
+static uint8_t api_salt[16] = {2};
+
+
+/* Size received by RecordSize(), which then fails so that nothing is allocated */
+static size_t recorded_size = 0;
+
+static int RecordSize(uint8_t **memory, size_t bytes_to_allocate) {
+    (void) memory;
+    recorded_size = bytes_to_allocate;
+    return ARGON2_MEMORY_ALLOCATION_ERROR;
+}
+
+static void FreeNothing(uint8_t *memory, size_t bytes_to_allocate) {
+    (void) memory;
+    (void) bytes_to_allocate;
+}
+
+/* The allocator callback receives the whole block matrix, also for 4 GiB (2^22 blocks) and more */
+static bool CheckLargeAllocationSize(char* failure, size_t failure_length) {
+    if (sizeof (size_t) < sizeof (uint64_t)) {
+        return true;
+    }
+    const uint32_t m_costs[] = {UINT32_C(1) << 22, (UINT32_C(1) << 22) + 4, UINT32_C(0xFFFFFFFC)};
+    for (size_t i = 0; i < sizeof (m_costs) / sizeof (m_costs[0]); ++i) {
+        uint8_t out[API_TAG_LENGTH];
+        Argon2_Context context = {
+            .out = out, .outlen = sizeof (out),
+            .pwd = api_pwd, .pwdlen = sizeof (api_pwd),
+            .salt = api_salt, .saltlen = sizeof (api_salt),
+            .t_cost = 1, .m_cost = m_costs[i], .lanes = 1,
+            .allocate_cbk = RecordSize, .free_cbk = FreeNothing
+        };
+        recorded_size = 0;
+        int result = Argon2d(&context);
+        size_t expected = (size_t) m_costs[i] * 1024;
+        if (ARGON2_MEMORY_ALLOCATION_ERROR != result || recorded_size != expected) {
+            snprintf(failure, failure_length, "m_cost %" PRIu32 ": %zu bytes requested instead of %zu (%s)",
+                    m_costs[i], recorded_size, expected, ErrorMessage(result));
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/* Sizes received by the huge-page callbacks */
+static size_t allocated_size = 0;
+static size_t freed_size = 0;
+
+static int AllocateHugePagesRecorded(uint8_t **memory, size_t bytes_to_allocate) {
+    allocated_size = bytes_to_allocate;
+    return Argon2_AllocateHugePages(memory, bytes_to_allocate);
+}
+
+static void FreeHugePagesRecorded(uint8_t *memory, size_t bytes_to_allocate) {
+    freed_size = bytes_to_allocate;
+    Argon2_FreeHugePages(memory, bytes_to_allocate);
+}
+
+/* The huge-page allocator is given back the size it allocated, and the tag is the one of the internal allocation */
+static bool CheckHugePagesRoundTrip(char* failure, size_t failure_length) {
+    uint8_t expected[API_TAG_LENGTH];
+    uint8_t out[API_TAG_LENGTH];
+    Argon2_Context reference = {
+        .out = expected, .outlen = sizeof (expected),
+        .pwd = api_pwd, .pwdlen = sizeof (api_pwd),
+        .salt = api_salt, .saltlen = sizeof (api_salt),
+        .t_cost = 2, .m_cost = 4096, .lanes = 4
+    };
+    Argon2_Context context = {
+        .out = out, .outlen = sizeof (out),
+        .pwd = api_pwd, .pwdlen = sizeof (api_pwd),
+        .salt = api_salt, .saltlen = sizeof (api_salt),
+        .t_cost = 2, .m_cost = 4096, .lanes = 4,
+        .allocate_cbk = AllocateHugePagesRecorded, .free_cbk = FreeHugePagesRecorded
+    };
+    int result = Argon2d(&reference);
+    if (ARGON2_OK == result) {
+        result = Argon2d(&context);
+    }
+    if (ARGON2_OK != result) {
+        snprintf(failure, failure_length, "%s", ErrorMessage(result));
+        return false;
+    }
+    if (allocated_size != (size_t) 4096 * 1024 || freed_size != allocated_size) {
+        snprintf(failure, failure_length, "%zu bytes allocated, %zu freed", allocated_size, freed_size);
+        return false;
+    }
+    if (memcmp(out, expected, sizeof (out)) != 0) {
+        snprintf(failure, failure_length, "tag differs from the one of the internal allocation");
+        return false;
+    }
+    return true;
+}
+
+
+/* Completions of the submitted contexts, counted under the lock */
+enum { API_SUBMITTED = 2, API_SUBMIT_TIMEOUT_S = 20 };
+
+typedef struct Api_completions Api_completions;
+struct Api_completions {
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    const Argon2_Context* contexts;
+    uint32_t count;
+    int results[API_SUBMITTED];
+};
+
+static void RecordCompletion(Argon2_Context* context, int result, void* user_data) {
+    Api_completions* completions = (Api_completions*) user_data;
+    pthread_mutex_lock(&completions->lock);
+    completions->results[context - completions->contexts] = result;
+    ++completions->count;
+    pthread_cond_signal(&completions->done);
+    pthread_mutex_unlock(&completions->lock);
+}
+
+/*
+ * Two contexts submitted to a single worker with one arena and a deferred wipe: the second one needs the wipe of the first,
+ * which must not be queued behind it
+ */
+static bool CheckSubmitDeferredWipe(char* failure, size_t failure_length) {
+    Argon2_ThreadPool* pool = Argon2_ThreadPoolCreate(1, false);
+    Argon2_Arena* arena = Argon2_ArenaCreate(1024, 2);
+    if (pool == NULL || arena == NULL) {
+        snprintf(failure, failure_length, "cannot create the pool or the arena");
+        return false;
+    }
+    uint8_t out[API_SUBMITTED][API_TAG_LENGTH];
+    Argon2_Context contexts[API_SUBMITTED] = {
+        {
+            .out = out[0], .outlen = API_TAG_LENGTH,
+            .pwd = api_pwd, .pwdlen = sizeof (api_pwd),
+            .salt = api_salt, .saltlen = sizeof (api_salt),
+            .t_cost = 2, .m_cost = 1024, .lanes = 2,
+            .clear_memory = true, .thread_pool = pool, .arena = arena, .defer_wipe = true
+        },
+        {
+            .out = out[1], .outlen = API_TAG_LENGTH,
+            .pwd = api_pwd, .pwdlen = sizeof (api_pwd),
+            .salt = api_salt, .saltlen = sizeof (api_salt),
+            .t_cost = 2, .m_cost = 1024, .lanes = 2,
+            .clear_memory = true, .thread_pool = pool, .arena = arena, .defer_wipe = true
+        }
+    };
+    Api_completions completions = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, contexts, 0, {0}};
+    for (uint32_t i = 0; i < API_SUBMITTED; ++i) {
+        int result = Argon2_Submit(pool, &contexts[i], Argon2_d, RecordCompletion, &completions);
+        if (ARGON2_OK != result) {
+            snprintf(failure, failure_length, "submit %" PRIu32 ": %s", i, ErrorMessage(result));
+            return false;
+        }
+    }
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += API_SUBMIT_TIMEOUT_S;
+    pthread_mutex_lock(&completions.lock);
+    while (completions.count < API_SUBMITTED) {
+        if (0 != pthread_cond_timedwait(&completions.done, &completions.lock, &deadline)) {
+            break;
+        }
+    }
+    uint32_t completed = completions.count;
+    pthread_mutex_unlock(&completions.lock);
+    if (completed < API_SUBMITTED) {
+        // The worker is stuck: the pool and the arena are left as they are
+        snprintf(failure, failure_length, "%" PRIu32 " of %d contexts completed after %d s", completed, API_SUBMITTED, API_SUBMIT_TIMEOUT_S);
+        return false;
+    }
+
+    Argon2_ThreadPoolDestroy(pool);
+    Argon2_ArenaDestroy(arena);
+    bool ok = true;
+    for (uint32_t i = 0; i < API_SUBMITTED; ++i) {
+        if (ARGON2_OK != completions.results[i]) {
+            snprintf(failure, failure_length, "context %" PRIu32 ": %s", i, ErrorMessage(completions.results[i]));
+            ok = false;
+        }
+    }
+    if (ok && memcmp(out[0], out[1], API_TAG_LENGTH) != 0) {
+        snprintf(failure, failure_length, "the two tags differ");
+        ok = false;
+    }
+    return ok;
+}
+
+
+/* Result given by Argon2_Submit() to RecordResult() */
+static int submitted_result = ARGON2_OK;
+
+static void RecordResult(Argon2_Context* context, int result, void* user_data) {
+    (void) context;
+    (void) user_data;
+    submitted_result = result;
+}
+
+/* MAX_ARGON2_TYPE is rejected by every entry point taking a type, before anything is hashed */
+static bool CheckTypeRejected(char* failure, size_t failure_length) {
+    uint8_t out[API_TAG_LENGTH];
+    uint8_t tag[API_TAG_LENGTH] = {0};
+    Argon2_Context context = {
+        .out = out, .outlen = sizeof (out),
+        .pwd = api_pwd, .pwdlen = sizeof (api_pwd),
+        .salt = api_salt, .saltlen = sizeof (api_salt),
+        .t_cost = 1, .m_cost = 64, .lanes = 1
+    };
+    Argon2_Context* contexts[] = {&context};
+    Argon2_State* state = NULL;
+    const char* names[] = {"Argon2_HashBatch", "Argon2_Submit", "Argon2_Verify", "Argon2_Init"};
+    int results[4] = {ARGON2_OK, ARGON2_OK, ARGON2_OK, ARGON2_OK};
+    // The batch and the submission report the error of the context, not the one of the call
+    Argon2_HashBatch(contexts, 1, MAX_ARGON2_TYPE, &results[0], NULL);
+    submitted_result = ARGON2_OK;
+    Argon2_Submit(NULL, &context, MAX_ARGON2_TYPE, RecordResult, NULL);
+    results[1] = submitted_result;
+    results[2] = Argon2_Verify(&context, MAX_ARGON2_TYPE, tag, NULL);
+    results[3] = Argon2_Init(&state, &context, MAX_ARGON2_TYPE);
+    for (size_t i = 0; i < sizeof (results) / sizeof (results[0]); ++i) {
+        if (ARGON2_INCORRECT_TYPE != results[i]) {
+            snprintf(failure, failure_length, "%s: %s", names[i], ErrorMessage(results[i]));
+            return false;
+        }
+    }
+    return true;
+}
+
+
+/* The tuner keeps the passes that tradeoff attacks need for password-independent addressing, even when they exceed the budget */
+static bool CheckTuneMinimumPasses(char* failure, size_t failure_length) {
+    const enum Argon2_type types[] = {Argon2_i, Argon2_di, Argon2_id};
+    for (size_t i = 0; i < sizeof (types) / sizeof (types[0]); ++i) {
+        Argon2_Params params;
+        int result = Argon2_Tune(types[i], 1, 256, 1, NULL, &params);
+        if (ARGON2_OK != result) {
+            snprintf(failure, failure_length, "type %d: %s", (int) types[i], ErrorMessage(result));
+            return false;
+        }
+        if (params.t_cost < 3 || params.lanes != 1) {
+            snprintf(failure, failure_length, "type %d: t_cost %" PRIu32 ", lanes %" PRIu32, (int) types[i], params.t_cost, params.lanes);
+            return false;
+        }
+    }
+    return true;
+}
+
+
+typedef struct Api_test Api_test;
+struct Api_test {
+    const char* name;
+    Api_check_t check;
+};
+
+static const Api_test api_tests[] = {
+    {"large allocation size", CheckLargeAllocationSize},
+    {"huge pages round trip", CheckHugePagesRoundTrip},
+    {"submit with a deferred wipe", CheckSubmitDeferredWipe},
+    {"tune minimum passes", CheckTuneMinimumPasses},
+    {"type rejected", CheckTypeRejected},
+};
+
+int main(void) {
+    uint32_t failed = 0;
+    uint32_t count = sizeof (api_tests) / sizeof (api_tests[0]);
+    for (uint32_t i = 0; i < count; ++i) {
+        char failure[256] = "";
+        if (api_tests[i].check(failure, sizeof (failure))) {
+            printf("%-32s: OK\n", api_tests[i].name);
+        } else {
+            printf("%-32s: FAILED, %s\n", api_tests[i].name, failure);
+            ++failed;
+        }
+    }
+    printf("%" PRIu32 " API checks, %" PRIu32 " failed\n", count, failed);
+    return (failed == 0) ? 0 : 1;
+}
@@ -0,0 +1,408 @@
+/*
+ * Argon2 source code package
+ *
+ * This work is licensed under a Creative Commons CC0 1.0 License/Waiver.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+
+/*For clock_gettime*/
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "argon2.h"
+
+
+/* Limits of the lists given on the command line */
+enum { MAX_POINTS = 32 };
+
+enum Output_format {
+    FORMAT_TEXT,
+    FORMAT_CSV,
+    FORMAT_JSON
+};
+
+static const char* type_names[] = {"Argon2d", "Argon2i", "Argon2di", "Argon2id", "Argon2ds"};
+static const char* impl_names[] = {"auto", "ref", "sse", "avx2", "avx512", "neon"};
+static const char* storage_names[] = {"memory", "mapped"};
+static int (*const modes[])(Argon2_Context*) = {Argon2d, Argon2i, Argon2di, Argon2id, Argon2ds};
+
+/*
+ * Benchmark settings: the points measured are all combinations of types, implementations, memory costs and lanes
+ */
+typedef struct Bench_settings Bench_settings;
+struct Bench_settings {
+    enum Argon2_type types[MAX_POINTS];
+    uint32_t type_count;
+    enum Argon2_impl impls[MAX_POINTS];
+    uint32_t impl_count;
+    uint32_t m_costs[MAX_POINTS];
+    uint32_t m_cost_count;
+    uint32_t lanes[MAX_POINTS];
+    uint32_t lanes_count;
+    uint32_t t_cost;
+    uint32_t warmup; //runs before the measured ones
+    uint32_t runs; //measured runs per point
+    bool use_pool; //lanes - 1 workers in a pool, otherwise threads created for every slice
+    bool use_arena; //memory allocated once per point, so page faults are not measured
+    const char* mapped_path; //if set, every point is also measured with the memory mapped onto this file or directory
+    enum Output_format format;
+};
+
+/*
+ * Measurements of one point
+ */
+typedef struct Bench_result Bench_result;
+struct Bench_result {
+    int error; //ARGON2_OK or the error code of the first failed run
+    double median_ms;
+    double p99_ms;
+    double min_ms;
+    double hashes_per_second; //at the median latency
+    double fill_gib_per_second; //memory blocks filled (all passes) per second at the median latency
+    bool has_gap; //set for Argon2ds points
+    double ds_gap_percent; //median latency of Argon2ds relative to the matching Argon2d point, in percent
+};
+
+static double Milliseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static int CompareDoubles(const void* a, const void* b) {
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+/* Number of blocks Argon2 uses for the memory cost and lanes, rounded as the library does */
+static uint32_t MemoryBlocks(uint32_t m_cost, uint32_t lanes) {
+    uint32_t memory_blocks = m_cost;
+    if (memory_blocks < 2 * SYNC_POINTS * lanes) {
+        memory_blocks = 2 * SYNC_POINTS * lanes;
+    }
+    return memory_blocks / (lanes * SYNC_POINTS) * (lanes * SYNC_POINTS);
+}
+
+/*
+ * Hashes settings->warmup + settings->runs times with the given parameters and computes the statistics of the measured runs.
+ * If @a mapped, the memory is allocated with Argon2_AllocateMappedFile (and never from an arena)
+ */
+static void MeasurePoint(const Bench_settings* settings, enum Argon2_type type, uint32_t m_cost, uint32_t lanes, bool mapped, Bench_result* result) {
+    uint8_t out[32];
+    uint8_t pwd[32];
+    uint8_t salt[16];
+    memset(pwd, 0, sizeof (pwd));
+    memset(salt, 1, sizeof (salt));
+    memset(result, 0, sizeof (Bench_result));
+
+    Argon2_ThreadPool* pool = (settings->use_pool && lanes > 1) ? Argon2_ThreadPoolCreate(lanes - 1, false) : NULL;
+    Argon2_Arena* arena = (settings->use_arena && !mapped) ? Argon2_ArenaCreate(m_cost, lanes) : NULL;
+    if (settings->use_arena && !mapped && arena == NULL) {
+        result->error = ARGON2_MEMORY_ALLOCATION_ERROR;
+        Argon2_ThreadPoolDestroy(pool);
+        return;
+    }
+
+    double* times = malloc(settings->runs * sizeof (double));
+    if (times == NULL) {
+        result->error = ARGON2_MEMORY_ALLOCATION_ERROR;
+    }
+    for (uint32_t run = 0; result->error == ARGON2_OK && run < settings->warmup + settings->runs; ++run) {
+        Argon2_Context context = {
+            .out = out,
+            .outlen = sizeof (out),
+            .pwd = pwd,
+            .pwdlen = sizeof (pwd),
+            .salt = salt,
+            .saltlen = sizeof (salt),
+            .t_cost = settings->t_cost,
+            .m_cost = m_cost,
+            .lanes = lanes,
+            .allocate_cbk = mapped ? Argon2_AllocateMappedFile : NULL,
+            .free_cbk = mapped ? Argon2_FreeMappedFile : NULL,
+            .thread_pool = pool,
+            .arena = arena
+        };
+        double start = Milliseconds();
+        result->error = modes[type](&context);
+        double elapsed = Milliseconds() - start;
+        if (run >= settings->warmup) {
+            times[run - settings->warmup] = elapsed;
+        }
+    }
+
+    if (result->error == ARGON2_OK) {
+        qsort(times, settings->runs, sizeof (double), CompareDoubles);
+        uint32_t n = settings->runs;
+        result->median_ms = (n % 2) ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+        uint32_t p99_rank = (uint32_t) ((99 * (uint64_t) n + 99) / 100); // nearest rank, ceil(0.99 n)
+        result->p99_ms = times[p99_rank - 1];
+        result->min_ms = times[0];
+        result->hashes_per_second = 1e3 / result->median_ms;
+        double filled = (double) MemoryBlocks(m_cost, lanes) * 1024 * settings->t_cost;
+        result->fill_gib_per_second = filled / (1 << 30) / (result->median_ms / 1e3);
+    }
+
+    free(times);
+    Argon2_ArenaDestroy(arena);
+    Argon2_ThreadPoolDestroy(pool);
+}
+
+static void PrintHeader(const Bench_settings* settings) {
+    switch (settings->format) {
+        case FORMAT_TEXT:
+            printf("%-9s %-7s %-7s %10s %5s %6s %5s %11s %11s %11s %10s %8s %8s\n",
+                    "type", "impl", "storage", "m_cost", "lanes", "t_cost", "runs", "median_ms", "p99_ms", "min_ms", "hashes/s", "GiB/s", "ds_vs_d");
+            break;
+        case FORMAT_CSV:
+            printf("type,impl,storage,m_cost,lanes,t_cost,runs,median_ms,p99_ms,min_ms,hashes_per_s,fill_gib_per_s,ds_vs_d_percent,error\n");
+            break;
+        case FORMAT_JSON:
+            printf("[\n");
+            break;
+    }
+}
+
+static void PrintResult(const Bench_settings* settings, enum Argon2_type type, uint32_t m_cost, uint32_t lanes, bool mapped,
+        const Bench_result* result, bool first) {
+    const char* impl = Argon2_ImplName();
+    const char* storage = storage_names[mapped];
+    char gap[32] = "";
+    switch (settings->format) {
+        case FORMAT_TEXT:
+            if (result->error != ARGON2_OK) {
+                printf("%-9s %-7s %-7s %10u %5u %6u %5u error %d: %s\n", type_names[type], impl, storage, m_cost, lanes, settings->t_cost, settings->runs,
+                        result->error, ErrorMessage(result->error));
+            } else {
+                if (result->has_gap) {
+                    snprintf(gap, sizeof (gap), "%+.1f%%", result->ds_gap_percent);
+                } else {
+                    snprintf(gap, sizeof (gap), "-");
+                }
+                printf("%-9s %-7s %-7s %10u %5u %6u %5u %11.3f %11.3f %11.3f %10.1f %8.3f %8s\n", type_names[type], impl, storage, m_cost, lanes, settings->t_cost, settings->runs,
+                        result->median_ms, result->p99_ms, result->min_ms, result->hashes_per_second, result->fill_gib_per_second, gap);
+            }
+            break;
+        case FORMAT_CSV:
+            if (result->has_gap) {
+                snprintf(gap, sizeof (gap), "%.2f", result->ds_gap_percent);
+            }
+            printf("%s,%s,%s,%u,%u,%u,%u,%.4f,%.4f,%.4f,%.2f,%.4f,%s,%d\n", type_names[type], impl, storage, m_cost, lanes, settings->t_cost, settings->runs,
+                    result->median_ms, result->p99_ms, result->min_ms, result->hashes_per_second, result->fill_gib_per_second, gap, result->error);
+            break;
+        case FORMAT_JSON:
+            if (result->has_gap) {
+                snprintf(gap, sizeof (gap), "%.2f", result->ds_gap_percent);
+            } else {
+                snprintf(gap, sizeof (gap), "null");
+            }
+            printf("%s  {\"type\": \"%s\", \"impl\": \"%s\", \"storage\": \"%s\", \"m_cost\": %u, \"lanes\": %u, \"t_cost\": %u, \"runs\": %u, "
+                    "\"median_ms\": %.4f, \"p99_ms\": %.4f, \"min_ms\": %.4f, \"hashes_per_s\": %.2f, \"fill_gib_per_s\": %.4f, \"ds_vs_d_percent\": %s, \"error\": %d}",
+                    first ? "" : ",\n", type_names[type], impl, storage, m_cost, lanes, settings->t_cost, settings->runs,
+                    result->median_ms, result->p99_ms, result->min_ms, result->hashes_per_second, result->fill_gib_per_second, gap, result->error);
+            break;
+    }
+}
+
+static void PrintFooter(const Bench_settings* settings) {
+    if (settings->format == FORMAT_JSON) {
+        printf("\n]\n");
+    }
+}
+
+/* Parses a comma-separated list of numbers, returns the number of values */
+static uint32_t ParseNumbers(char* list, uint32_t* values) {
+    uint32_t count = 0;
+    for (char* item = strtok(list, ","); item != NULL && count < MAX_POINTS; item = strtok(NULL, ",")) {
+        values[count++] = (uint32_t) strtoul(item, NULL, 10);
+    }
+    return count;
+}
+
+/* Parses a comma-separated list of names, returns the number of values or 0 if a name is unknown */
+static uint32_t ParseNames(char* list, const char** names, int name_count, int* values) {
+    uint32_t count = 0;
+    for (char* item = strtok(list, ","); item != NULL && count < MAX_POINTS; item = strtok(NULL, ",")) {
+        int found = -1;
+        for (int n = 0; n < name_count; ++n) {
+            if (strcmp(item, names[n]) == 0) {
+                found = n;
+            }
+        }
+        if (found < 0) {
+            printf("Unknown name %s\n", item);
+            return 0;
+        }
+        values[count++] = found;
+    }
+    return count;
+}
+
+static void PrintHelp(void) {
+    printf("====================================== \n");
+    printf("Argon2 - benchmark \n");
+    printf("====================================== \n");
+    printf("Measures the wall-clock latency of every combination of the types, implementations, memory costs and lanes.\n");
+    printf("Options:\n");
+    printf("\t -types <comma-separated list of Argon2d; Argon2i; Argon2di; Argon2id; Argon2ds> (default Argon2d,Argon2i,Argon2id,Argon2ds)\n");
+    printf("\t -impls <comma-separated list of ref; sse; avx2; avx512; neon> (default: those supported by the CPU)\n");
+    printf("\t -mcost <comma-separated list of m_cost in KBytes> (default 1024,16384,262144)\n");
+    printf("\t -lanes <comma-separated list of lanes> (default 1,4)\n");
+    printf("\t -tcost <t_cost> (default 1)\n");
+    printf("\t -warmup <runs> (default 1)\n");
+    printf("\t -runs <runs> (default 10)\n");
+    printf("\t -no-pool: create threads for every slice instead of using a worker pool\n");
+    printf("\t -arena: allocate the memory once per point, so that page faults are not measured\n");
+    printf("\t -mapped <file, device or directory>: also measure every point with the memory mapped onto it (never from the arena)\n");
+    printf("\t -format <text; csv; json> (default text)\n");
+    printf("Argon2ds points also give their latency relative to the Argon2d point with the same parameters (ds_vs_d).\n");
+    printf("The prefetching of Argon2i and Argon2id shows beyond the caches, e.g. -types Argon2i,Argon2id -mcost 1048576,2097152 -lanes 1,4 -runs 3\n");
+    printf("\t -help\n");
+}
+
+int main(int argc, char* argv[]) {
+    Bench_settings settings = {
+        .types = {Argon2_d, Argon2_i, Argon2_id, Argon2_ds},
+        .type_count = 4,
+        .impl_count = 0,
+        .m_costs = {1 << 10, 1 << 14, 1 << 18},
+        .m_cost_count = 3,
+        .lanes = {1, 4},
+        .lanes_count = 2,
+        .t_cost = 1,
+        .warmup = 1,
+        .runs = 10,
+        .use_pool = true,
+        .use_arena = false,
+        .mapped_path = NULL,
+        .format = FORMAT_TEXT
+    };
+
+    for (int i = 1; i < argc; i++) {
+        int values[MAX_POINTS];
+        bool has_value = i < argc - 1;
+
+        if (strcmp(argv[i], "-help") == 0) {
+            PrintHelp();
+            return 0;
+        } else if (strcmp(argv[i], "-types") == 0 && has_value) {
+            settings.type_count = ParseNames(argv[++i], type_names, MAX_ARGON2_TYPE, values);
+            for (uint32_t t = 0; t < settings.type_count; ++t) {
+                settings.types[t] = (enum Argon2_type) values[t];
+            }
+        } else if (strcmp(argv[i], "-impls") == 0 && has_value) {
+            settings.impl_count = ParseNames(argv[++i], impl_names, MAX_ARGON2_IMPL, values);
+            for (uint32_t m = 0; m < settings.impl_count; ++m) {
+                settings.impls[m] = (enum Argon2_impl) values[m];
+            }
+            if (settings.impl_count == 0) {
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-mcost") == 0 && has_value) {
+            settings.m_cost_count = ParseNumbers(argv[++i], settings.m_costs);
+        } else if (strcmp(argv[i], "-lanes") == 0 && has_value) {
+            settings.lanes_count = ParseNumbers(argv[++i], settings.lanes);
+        } else if (strcmp(argv[i], "-tcost") == 0 && has_value) {
+            settings.t_cost = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-warmup") == 0 && has_value) {
+            settings.warmup = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-runs") == 0 && has_value) {
+            settings.runs = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "-no-pool") == 0) {
+            settings.use_pool = false;
+        } else if (strcmp(argv[i], "-arena") == 0) {
+            settings.use_arena = true;
+        } else if (strcmp(argv[i], "-mapped") == 0 && has_value) {
+            settings.mapped_path = argv[++i];
+            if (Argon2_SetMappedFile(settings.mapped_path) != ARGON2_OK) {
+                printf("Cannot map the memory onto %s\n", settings.mapped_path);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "-format") == 0 && has_value) {
+            ++i;
+            if (strcmp(argv[i], "csv") == 0) {
+                settings.format = FORMAT_CSV;
+            } else if (strcmp(argv[i], "json") == 0) {
+                settings.format = FORMAT_JSON;
+            } else {
+                settings.format = FORMAT_TEXT;
+            }
+        } else {
+            printf("Unknown option %s, see -help\n", argv[i]);
+            return 1;
+        }
+    }
+    if (settings.type_count == 0 || settings.m_cost_count == 0 || settings.lanes_count == 0 || settings.runs == 0) {
+        printf("Nothing to measure, see -help\n");
+        return 1;
+    }
+
+    // By default every implementation the CPU supports
+    if (settings.impl_count == 0) {
+        for (int impl = ARGON2_IMPL_REF; impl < MAX_ARGON2_IMPL; ++impl) {
+            if (Argon2_SelectImpl((enum Argon2_impl) impl) == ARGON2_OK) {
+                settings.impls[settings.impl_count++] = (enum Argon2_impl) impl;
+            }
+        }
+    }
+
+    int status = 0;
+    bool first = true;
+    PrintHeader(&settings);
+    for (uint32_t m = 0; m < settings.impl_count; ++m) {
+        int result = Argon2_SelectImpl(settings.impls[m]);
+        if (result != ARGON2_OK) {
+            fprintf(stderr, "Implementation %s: %s\n", impl_names[settings.impls[m]], ErrorMessage(result));
+            status = 1;
+            continue;
+        }
+        // Median latency of the Argon2d points of this implementation, 0 until measured, for the gap of Argon2ds
+        static double d_median_ms[MAX_POINTS][MAX_POINTS][2];
+        memset(d_median_ms, 0, sizeof (d_median_ms));
+        for (uint32_t t = 0; t < settings.type_count; ++t) {
+            for (uint32_t mc = 0; mc < settings.m_cost_count; ++mc) {
+                for (uint32_t l = 0; l < settings.lanes_count; ++l) {
+                    for (int mapped = 0; mapped <= (settings.mapped_path != NULL); ++mapped) {
+                        Bench_result bench_result;
+                        MeasurePoint(&settings, settings.types[t], settings.m_costs[mc], settings.lanes[l], mapped, &bench_result);
+                        double* d_median = &d_median_ms[mc][l][mapped];
+                        if (settings.types[t] == Argon2_d && bench_result.error == ARGON2_OK) {
+                            *d_median = bench_result.median_ms;
+                        } else if (settings.types[t] == Argon2_ds && bench_result.error == ARGON2_OK) {
+                            if (*d_median == 0) {
+                                // Argon2d is not measured before this point: measure it for the gap only
+                                Bench_result d_result;
+                                MeasurePoint(&settings, Argon2_d, settings.m_costs[mc], settings.lanes[l], mapped, &d_result);
+                                *d_median = (d_result.error == ARGON2_OK) ? d_result.median_ms : 0;
+                            }
+                            if (*d_median > 0) {
+                                bench_result.has_gap = true;
+                                bench_result.ds_gap_percent = 100 * (bench_result.median_ms / *d_median - 1);
+                            }
+                        }
+                        PrintResult(&settings, settings.types[t], settings.m_costs[mc], settings.lanes[l], mapped, &bench_result, first);
+                        fflush(stdout);
+                        first = false;
+                        if (bench_result.error != ARGON2_OK) {
+                            status = 1;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    PrintFooter(&settings);
+    return status;
+}
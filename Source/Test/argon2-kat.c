@@ -0,0 +1,432 @@
+/*
+ * Argon2 source code package
+ *
+ * This work is licensed under a Creative Commons CC0 1.0 License/Waiver.
+ *
+ * You should have received a copy of the CC0 Public Domain Dedication along with
+ * this software. If not, see <http://creativecommons.org/publicdomain/zero/1.0/>.
+ */
+
+
+/*For clock_gettime*/
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "argon2.h"
+#include "argon2-core.h"
+#include "argon2-thread.h"
+
+
+/* Longest password, salt, secret, associated data and tag of a test vector */
+enum { MAX_KAT_INPUT = 256 };
+/* Copies of a test vector hashed at the same time in the batch checks */
+enum { KAT_BATCH_COPIES = 4 };
+
+static const char* type_names[] = {"Argon2d", "Argon2i", "Argon2di", "Argon2id", "Argon2ds"};
+
+
+/* Word of a block of the memory after a pass, as printed by InternalKat() */
+typedef struct Kat_word Kat_word;
+struct Kat_word {
+    uint32_t pass;
+    uint32_t block;
+    uint32_t index;
+    uint64_t value;
+};
+
+/*
+ * Test vector: the inputs and the expected values of TestVectors/<type>.txt.
+ * Some files do not hold the values of their type: Argon2di.txt is an Argon2i vector (argon2-tv -gen-tv -type Argon2di hashes with Argon2i)
+ * and Argon2ds.txt does not match the current S-box construction. Their type is then checked against the reference kernel
+ */
+typedef struct Kat_vector Kat_vector;
+struct Kat_vector {
+    enum Argon2_type type; //type of the file name
+    enum Argon2_type file_type; //type in the header of the file
+    bool against_ref; //the expected values are computed with the reference kernel rather than read
+    uint32_t t_cost;
+    uint32_t m_cost;
+    uint32_t lanes;
+    uint32_t outlen;
+    uint8_t pwd[MAX_KAT_INPUT];
+    uint32_t pwdlen;
+    uint8_t salt[MAX_KAT_INPUT];
+    uint32_t saltlen;
+    uint8_t secret[MAX_KAT_INPUT];
+    uint32_t secretlen;
+    uint8_t ad[MAX_KAT_INPUT];
+    uint32_t adlen;
+    uint8_t digest[PREHASH_DIGEST_LENGTH];
+    Kat_word* words; //in the order of the file, so sorted by pass
+    uint32_t word_count;
+    uint8_t tag[MAX_KAT_INPUT];
+};
+
+enum Kat_mode {
+    MODE_THREADS, //lanes filled by threads created for every slice
+    MODE_POOL, //lanes filled by the workers of the pool
+    MODE_BATCH, //KAT_BATCH_COPIES hashes run together on the pool, as with Argon2_HashBatch()
+    MAX_KAT_MODE
+};
+
+static const char* mode_names[] = {"threads", "pool", "batch"};
+
+/*
+ * Check of one test vector with one kernel in one mode
+ */
+typedef struct Kat_check Kat_check;
+struct Kat_check {
+    Kat_vector* vector;
+    const Argon2_core_t* core;
+    enum Kat_mode mode;
+    Argon2_ThreadPool* pool;
+    bool capture; //the expected values are taken from this run instead of checked
+    char failure[128]; //empty if the check passed
+};
+
+static double Milliseconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+/*
+ * Reads the bytes of a line "<name>[<length>]: xx xx ..." or, if @a length is NULL, "<name>: xx xx ..." of @a expected bytes
+ * @return false if the line has another name or is malformed
+ */
+static bool ParseBytes(const char* line, const char* name, uint8_t* bytes, uint32_t* length, uint32_t expected) {
+    size_t name_length = strlen(name);
+    if (strncmp(line, name, name_length) != 0) {
+        return false;
+    }
+    const char* c = line + name_length;
+    if (length != NULL) {
+        if (*c != '[') {
+            return false;
+        }
+        char* end;
+        unsigned long value = strtoul(c + 1, &end, 10);
+        if (end[0] != ']' || value > MAX_KAT_INPUT) {
+            return false;
+        }
+        expected = (uint32_t) value;
+        *length = expected;
+        c = end + 1;
+    }
+    if (*c != ':') {
+        return false;
+    }
+    ++c;
+    for (uint32_t i = 0; i < expected; ++i) {
+        char* end;
+        unsigned long value = strtoul(c, &end, 16);
+        if (end == c || value > 0xFF) {
+            return false;
+        }
+        bytes[i] = (uint8_t) value;
+        c = end;
+    }
+    return true;
+}
+
+/*
+ * Reads a test vector in the format written by argon2-tv -gen-tv
+ * @return false if the file cannot be read or is malformed
+ */
+static bool ParseVector(const char* path, Kat_vector* vector) {
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+        return false;
+    }
+    memset(vector, 0, sizeof (Kat_vector));
+
+    char line[1024];
+    bool valid = fgets(line, sizeof (line), fp) != NULL;
+    if (valid) {
+        const char* name = line + strspn(line, "=");
+        line[strcspn(line, "\r\n")] = '\0';
+        valid = false;
+        for (int t = 0; t < MAX_ARGON2_TYPE; ++t) {
+            if (strcmp(name, type_names[t]) == 0) {
+                vector->file_type = (enum Argon2_type) t;
+                valid = true;
+            }
+        }
+    }
+    valid = valid && fgets(line, sizeof (line), fp) != NULL &&
+            sscanf(line, "Iterations: %" SCNu32 ", Memory: %" SCNu32 " KBytes, Parallelism: %" SCNu32 " lanes, Tag length: %" SCNu32 " bytes",
+            &vector->t_cost, &vector->m_cost, &vector->lanes, &vector->outlen) == 4 && vector->outlen <= MAX_KAT_INPUT;
+    valid = valid && fgets(line, sizeof (line), fp) != NULL && ParseBytes(line, "Password", vector->pwd, &vector->pwdlen, 0);
+    valid = valid && fgets(line, sizeof (line), fp) != NULL && ParseBytes(line, "Salt", vector->salt, &vector->saltlen, 0);
+    valid = valid && fgets(line, sizeof (line), fp) != NULL && ParseBytes(line, "Secret", vector->secret, &vector->secretlen, 0);
+    valid = valid && fgets(line, sizeof (line), fp) != NULL && ParseBytes(line, "Associated data", vector->ad, &vector->adlen, 0);
+    valid = valid && fgets(line, sizeof (line), fp) != NULL && ParseBytes(line, "Pre-hashing digest", vector->digest, NULL, PREHASH_DIGEST_LENGTH);
+
+    // The memory after each pass, then the tag
+    uint32_t pass = 0;
+    uint32_t capacity = 0;
+    bool tag_found = false;
+    while (valid && !tag_found && fgets(line, sizeof (line), fp) != NULL) {
+        Kat_word word;
+        if (sscanf(line, " After pass %" SCNu32 ":", &pass) == 1 || line[0] == '\n') {
+            continue;
+        }
+        if (sscanf(line, "Block %" SCNu32 " [%" SCNu32 "]: %" SCNx64, &word.block, &word.index, &word.value) == 3) {
+            if (word.index >= WORDS_IN_BLOCK) {
+                valid = false;
+                break;
+            }
+            if (vector->word_count == capacity) {
+                capacity = (capacity == 0) ? 4096 : 2 * capacity;
+                Kat_word* words = realloc(vector->words, capacity * sizeof (Kat_word));
+                if (words == NULL) {
+                    valid = false;
+                    break;
+                }
+                vector->words = words;
+            }
+            word.pass = pass;
+            vector->words[vector->word_count++] = word;
+        } else {
+            tag_found = ParseBytes(line, "Tag", vector->tag, NULL, vector->outlen);
+            valid = tag_found;
+        }
+    }
+    fclose(fp);
+    if (!valid || !tag_found) {
+        free(vector->words);
+        vector->words = NULL;
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Hashes the test vector with the kernel and compares the pre-hashing digest, the memory after every pass and the tag with it,
+ * or, if @a check->capture, stores them into it
+ * @param pool Worker pool filling the lanes, NULL for a thread per lane
+ * @param failure Buffer receiving the first difference, left untouched if there is none
+ */
+static void RunVector(const Kat_check* check, Argon2_ThreadPool* pool, char* failure, size_t failure_length) {
+    Kat_vector* vector = check->vector;
+    uint8_t out[MAX_KAT_INPUT];
+    uint8_t pwd[MAX_KAT_INPUT];
+    uint8_t secret[MAX_KAT_INPUT];
+    memcpy(pwd, vector->pwd, vector->pwdlen);
+    memcpy(secret, vector->secret, vector->secretlen);
+    Argon2_Context context = {
+        .out = out,
+        .outlen = vector->outlen,
+        .pwd = pwd,
+        .pwdlen = vector->pwdlen,
+        .salt = vector->salt,
+        .saltlen = vector->saltlen,
+        .secret = secret,
+        .secretlen = vector->secretlen,
+        .ad = vector->ad,
+        .adlen = vector->adlen,
+        .t_cost = vector->t_cost,
+        .m_cost = vector->m_cost,
+        .lanes = vector->lanes,
+        .thread_pool = pool
+    };
+    int result = ValidateInputs(&context);
+    if (ARGON2_OK != result) {
+        snprintf(failure, failure_length, "%s", ErrorMessage(result));
+        return;
+    }
+
+    // 1. Digest of the inputs
+    uint8_t blockhash[PREHASH_DIGEST_LENGTH];
+    InitialHash(blockhash, &context, vector->type);
+    if (check->capture) {
+        memcpy(vector->digest, blockhash, PREHASH_DIGEST_LENGTH);
+    } else if (memcmp(blockhash, vector->digest, PREHASH_DIGEST_LENGTH) != 0) {
+        snprintf(failure, failure_length, "pre-hashing digest differs");
+        return;
+    }
+
+    // 2. Memory after every pass, with the kernel of the check
+    Argon2_instance_t instance = NewInstance(&context, vector->type);
+    instance.core = check->core;
+    result = Initialize(&instance, &context);
+    if (ARGON2_OK != result) {
+        snprintf(failure, failure_length, "%s", ErrorMessage(result));
+        return;
+    }
+    bool differs = false;
+    uint32_t w = 0;
+    for (uint32_t pass = 0; pass < instance.passes; ++pass) {
+        for (uint8_t slice = 0; slice < SYNC_POINTS; ++slice) {
+            FillSlice(&instance, pass, slice);
+        }
+        for (; w < vector->word_count && vector->words[w].pass == pass; ++w) {
+            Kat_word* word = &vector->words[w];
+            uint64_t value = (word->block < instance.memory_blocks) ? instance.state[word->block][word->index] : 0;
+            if (check->capture) {
+                word->value = value;
+            } else if (value != word->value && !differs) {
+                snprintf(failure, failure_length, "pass %" PRIu32 ", block %" PRIu32 " [%" PRIu32 "]: %016" PRIx64 " instead of %016" PRIx64,
+                        pass, word->block, word->index, value, word->value);
+                differs = true;
+            }
+        }
+    }
+
+    // 3. Tag, which also releases the memory
+    Finalize(&context, &instance);
+    if (check->capture) {
+        memcpy(vector->tag, out, vector->outlen);
+    } else if (!differs && memcmp(out, vector->tag, vector->outlen) != 0) {
+        snprintf(failure, failure_length, "tag differs");
+    }
+}
+
+/*
+ * Batch copy: its own failure buffer, as the copies run at the same time
+ */
+typedef struct Kat_batch_data Kat_batch_data;
+struct Kat_batch_data {
+    const Kat_check* check;
+    char failures[KAT_BATCH_COPIES][128];
+};
+
+static void BatchCopyJob(void* batch_data, uint32_t index) {
+    Kat_batch_data* my_data = (Kat_batch_data*) batch_data;
+    RunVector(my_data->check, my_data->check->pool, my_data->failures[index], sizeof (my_data->failures[index]));
+}
+
+static void CheckJob(void* checks, uint32_t index) {
+    Kat_check* check = (Kat_check*) checks + index;
+    if (MODE_BATCH == check->mode) {
+        Kat_batch_data batch_data;
+        memset(&batch_data, 0, sizeof (batch_data));
+        batch_data.check = check;
+        RunInParallel(check->pool, BatchCopyJob, &batch_data, KAT_BATCH_COPIES);
+        for (uint32_t copy = KAT_BATCH_COPIES; copy > 0; --copy) {
+            if (batch_data.failures[copy - 1][0] != '\0') {
+                snprintf(check->failure, sizeof (check->failure), "copy %" PRIu32 ": %s", copy - 1, batch_data.failures[copy - 1]);
+            }
+        }
+    } else {
+        RunVector(check, (MODE_POOL == check->mode) ? check->pool : NULL, check->failure, sizeof (check->failure));
+    }
+}
+
+static void PrintHelp(void) {
+    printf("====================================== \n");
+    printf("Argon2 - test vector check \n");
+    printf("====================================== \n");
+    printf("Checks every test vector with every kernel the CPU supports, with threads, with a worker pool and in batches,\n");
+    printf("all at the same time, and compares the pre-hashing digest, the memory after every pass and the tag with the vector.\n");
+    printf("Options:\n");
+    printf("\t -dir <directory of Argon2d.txt, Argon2i.txt, ...> (default TestVectors)\n");
+    printf("\t -threads <workers of the pool> (default 4)\n");
+    printf("\t -help\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* dir = "TestVectors";
+    uint32_t threads = 4;
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i < argc - 1;
+
+        if (strcmp(argv[i], "-help") == 0) {
+            PrintHelp();
+            return 0;
+        } else if (strcmp(argv[i], "-dir") == 0 && has_value) {
+            dir = argv[++i];
+        } else if (strcmp(argv[i], "-threads") == 0 && has_value) {
+            threads = (uint32_t) strtoul(argv[++i], NULL, 10);
+        } else {
+            printf("Unknown option %s, see -help\n", argv[i]);
+            return 1;
+        }
+    }
+
+    // 1. Kernels: the reference one and the optimized ones the CPU supports
+    const Argon2_core_t* cores[MAX_ARGON2_IMPL];
+    uint32_t core_count = 0;
+    cores[core_count++] = &Argon2_ref_core;
+    for (int impl = ARGON2_IMPL_REF + 1; impl < MAX_ARGON2_IMPL; ++impl) {
+        const Argon2_core_t* core = GetOptCore((enum Argon2_impl) impl);
+        if (core != NULL) {
+            cores[core_count++] = core;
+        }
+    }
+
+    // 2. Test vectors
+    Kat_vector vectors[MAX_ARGON2_TYPE];
+    for (int t = 0; t < MAX_ARGON2_TYPE; ++t) {
+        char path[4096];
+        snprintf(path, sizeof (path), "%s/%s.txt", dir, type_names[t]);
+        if (!ParseVector(path, &vectors[t])) {
+            printf("Cannot read the test vector %s\n", path);
+            for (int v = 0; v < t; ++v) {
+                free(vectors[v].words);
+            }
+            return 1;
+        }
+        vectors[t].type = (enum Argon2_type) t;
+        vectors[t].against_ref = vectors[t].file_type != vectors[t].type || Argon2_ds == vectors[t].type;
+    }
+
+    Argon2_ThreadPool* pool = Argon2_ThreadPoolCreate(threads, false);
+    if (pool == NULL) {
+        printf("Cannot create the worker pool\n");
+        return 1;
+    }
+
+    // 3. Expected values of the vectors checked against the reference kernel
+    double start = Milliseconds();
+    for (int t = 0; t < MAX_ARGON2_TYPE; ++t) {
+        if (vectors[t].against_ref) {
+            Kat_check reference = {&vectors[t], &Argon2_ref_core, MODE_THREADS, pool, true, ""};
+            CheckJob(&reference, 0);
+        }
+    }
+
+    // 4. All checks at the same time
+    Kat_check checks[MAX_ARGON2_TYPE * MAX_ARGON2_IMPL * MAX_KAT_MODE];
+    uint32_t check_count = 0;
+    for (int t = 0; t < MAX_ARGON2_TYPE; ++t) {
+        for (uint32_t c = 0; c < core_count; ++c) {
+            for (int mode = 0; mode < MAX_KAT_MODE; ++mode) {
+                Kat_check check = {&vectors[t], cores[c], (enum Kat_mode) mode, pool, false, ""};
+                checks[check_count++] = check;
+            }
+        }
+    }
+    RunInParallel(pool, CheckJob, checks, check_count);
+    double elapsed = Milliseconds() - start;
+
+    uint32_t failed = 0;
+    for (uint32_t i = 0; i < check_count; ++i) {
+        const Kat_check* check = &checks[i];
+        const char* against = check->vector->against_ref ? " (against ref)" : "";
+        if (check->failure[0] == '\0') {
+            printf("%-8s %-6s %-7s: OK%s\n", type_names[check->vector->type], check->core->name, mode_names[check->mode], against);
+        } else {
+            printf("%-8s %-6s %-7s: FAILED%s, %s\n", type_names[check->vector->type], check->core->name, mode_names[check->mode],
+                    against, check->failure);
+            ++failed;
+        }
+    }
+    printf("%" PRIu32 " checks, %" PRIu32 " failed, %.1f ms\n", check_count, failed, elapsed);
+
+    Argon2_ThreadPoolDestroy(pool);
+    for (int t = 0; t < MAX_ARGON2_TYPE; ++t) {
+        free(vectors[t].words);
+    }
+    return (failed == 0) ? 0 : 1;
+}
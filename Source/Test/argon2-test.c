@@ -15,6 +15,7 @@
 
 #include "time.h"
 #include "argon2.h"
+#include "blake2.h"
 
 
 /* Enable timing measurements */
@@ -121,89 +122,6 @@ void GenKat() {
     }
 }
 
-/*
- * Benchmarks Argon2 with salt length 16, password length 32, t_cost 3, and different threads and m_cost
- */
-void Benchmark() {
-    const uint32_t inlen = 32;
-
-    unsigned char out[32];
-    unsigned char zero_array[inlen];
-    unsigned char one_array[256];
-
-    uint32_t outlen = 16;
-    uint32_t saltlen = 16;
-    uint32_t t_cost = 1;
-
-    memset(zero_array, 0, inlen);
-    memset(one_array, 1, 256);
-    uint32_t thread_test[] = {1, 2, 4, 6, 8, 16};
-
-    for (uint32_t m_cost = (uint32_t) 1 << 10; m_cost <= (uint32_t) 1 << 22; m_cost *= 2) {
-        for (uint32_t thread_i = 0; thread_i < sizeof thread_test / sizeof *thread_test; thread_i++) {
-            uint32_t thread_n = thread_test[thread_i];
-
-#ifdef _MEASURE
-            uint64_t start_cycles, stop_cycles, stop_cycles_i, stop_cycles_di, stop_cycles_ds;
-            uint32_t ui1, ui2, ui3, ui4, ui5;
-
-            clock_t start_time = clock();
-            start_cycles = __rdtscp(&ui1);
-#endif
-
-            Argon2_Context context = {
-                .out = out,
-                .outlen = outlen,
-                .pwd = zero_array,
-                .pwdlen = inlen,
-                .salt = one_array,
-                .saltlen = saltlen,
-                .secret = NULL,
-                .secretlen = 0,
-                .ad = NULL,
-                .adlen = 0,
-                .t_cost = t_cost,
-                .m_cost = m_cost,
-                .lanes = thread_n
-            };
-            Argon2d(&context);
-
-#ifdef _MEASURE
-            stop_cycles = __rdtscp(&ui2);
-#endif
-            Argon2i(&context);
-#ifdef _MEASURE
-            stop_cycles_i = __rdtscp(&ui3);
-#endif
-            Argon2id(&context);
-#ifdef _MEASURE
-            stop_cycles_di = __rdtscp(&ui4);
-#endif
-            Argon2ds(&context);
-#ifdef _MEASURE
-            stop_cycles_ds = __rdtscp(&ui5);
-            clock_t stop_time = clock();
-
-            uint64_t delta_d = (stop_cycles - start_cycles) / (m_cost);
-            uint64_t delta_i = (stop_cycles_i - stop_cycles) / (m_cost);
-            uint64_t delta_id = (stop_cycles_di - stop_cycles_i) / m_cost;
-            uint64_t delta_ds = (stop_cycles_ds - stop_cycles_di) / m_cost;
-            float mcycles_d = (float) (stop_cycles - start_cycles) / (1 << 20);
-            float mcycles_i = (float) (stop_cycles_i - stop_cycles) / (1 << 20);
-            float mcycles_id = (float) (stop_cycles_di - stop_cycles_i) / (1 << 20);
-            float mcycles_ds = (float) (stop_cycles_ds - stop_cycles_di) / (1 << 20);
-            printf("Argon2d %d pass(es)  %d Mbytes %d threads:  %2.2f cpb %2.2f Mcycles \n", t_cost, m_cost >> 10, thread_n, (float) delta_d / 1024, mcycles_d);
-            printf("Argon2i %d pass(es)  %d Mbytes %d threads:  %2.2f cpb %2.2f Mcycles \n", t_cost, m_cost >> 10, thread_n, (float) delta_i / 1024, mcycles_i);
-            printf("Argon2id %d pass(es)  %d Mbytes %d threads:  %2.2f cpb %2.2f Mcycles \n", t_cost, m_cost >> 10, thread_n, (float) delta_id / 1024, mcycles_id);
-            printf("Argon2ds %d pass(es)  %d Mbytes %d threads:  %2.2f cpb %2.2f Mcycles \n", t_cost, m_cost >> 10, thread_n, (float) delta_ds / 1024, mcycles_ds);
-
-            float run_time = ((float) stop_time - start_time) / (CLOCKS_PER_SEC);
-            printf("%2.4f seconds\n\n", run_time);
-#endif
-        }
-    }
-}
-
 void Run(void *out, size_t outlen, size_t inlen, size_t saltlen, uint32_t t_cost, uint32_t m_cost) {
 #ifdef _MEASURE
     uint64_t start_cycles, stop_cycles, delta;
@@ -271,7 +189,7 @@ void GenerateTestVectors(const char *type) {
     Argon2_Context context = {out, out_length, pwd, pwd_length, salt, salt_length,
             secret, secret_length, ad, ad_length, t_cost, m_cost, lanes,
             myown_allocator, myown_deallocator,
-            clear_password, clear_secret, clear_memory};
+            clear_password, clear_secret, clear_memory, NULL, NULL, NULL, false};
 
     if (strcmp(type, "Argon2d") == 0) {
         printf("Test Argon2d\n");
@@ -302,6 +220,35 @@ void GenerateTestVectors(const char *type) {
     printf("Wrong Argon2 type!\n");
 }
 
+/*
+ * Prints the strongest parameters of the given type that hash within @a target_ms milliseconds using at most @a max_mib MiB,
+ * with @a thread_n lanes filled by a pool of thread_n - 1 workers and the calling thread
+ */
+void Tune(const char *type, uint32_t target_ms, uint32_t max_mib, unsigned thread_n) {
+    const char* type_names[] = {"Argon2d", "Argon2i", "Argon2di", "Argon2id", "Argon2ds"};
+    int type_index = -1;
+    for (int t = Argon2_d; t < MAX_ARGON2_TYPE; ++t) {
+        if (strcmp(type, type_names[t]) == 0) {
+            type_index = t;
+        }
+    }
+    if (type_index < 0) {
+        printf("Wrong Argon2 type!\n");
+        return;
+    }
+
+    Argon2_ThreadPool* pool = (thread_n > 1) ? Argon2_ThreadPoolCreate(thread_n - 1, false) : NULL;
+    Argon2_Params params;
+    printf("Tuning %s for %u ms and %u Mbytes with %u threads (%s)\n", type, target_ms, max_mib, thread_n, Argon2_ImplName());
+    int result = Argon2_Tune((enum Argon2_type) type_index, target_ms, max_mib << 10, thread_n, pool, &params);
+    if (result != ARGON2_OK) {
+        printf("Error %d: %s\n", result, ErrorMessage(result));
+    } else {
+        printf("t_cost %u  m_cost %u (%u Mbytes)  lanes %u:  %2.1f ms\n", params.t_cost, params.m_cost, params.m_cost >> 10, params.lanes, params.milliseconds);
+    }
+    Argon2_ThreadPoolDestroy(pool);
+}
+
 int main(int argc, char* argv[]) {
     // const unsigned int argon2_type_length = 10;
 
@@ -315,6 +262,8 @@ int main(int argc, char* argv[]) {
     uint32_t s_len = 16;
 
     bool generate_test_vectors = false;
+    uint32_t tune_ms = 0;
+    uint32_t tune_mib = 0;
     char *type = "Argon2d";
 
 #ifdef KAT
@@ -339,8 +288,10 @@ int main(int argc, char* argv[]) {
             printf("\t -saltlen < Salt : Length>\n");
             printf("\t -threads < Number of threads : % d.. % d>\n", MIN_LANES, MAX_LANES);
             printf("\t -type <Argon2d; Argon2di; Argon2ds; Argon2i; Argon2id >\n");
+            printf("\t -impl <auto; ref; sse; avx2; avx512; neon>\n");
+            printf("\t -blake2b <portable; sse41> (for tests: the BLAKE2b compression function, portable by default)\n");
             printf("\t -gen-tv\n");
-            printf("\t -benchmark\n");
+            printf("\t -tune <Latency budget : ms> <Memory cap : Mbytes>\n");
             printf("\t -help\n");
             printf("If no arguments given, Argon2 is called with default parameters t_cost=%d, m_cost=%d and threads=%d.\n", t_cost, m_cost, thread_n);
             return 0;
@@ -405,15 +356,59 @@ int main(int argc, char* argv[]) {
             }
         }
 
+        if (strcmp(argv[i], "-impl") == 0) {
+            if (i < argc - 1) {
+                i++;
+                const char* impl_names[] = {"auto", "ref", "sse", "avx2", "avx512", "neon"};
+                int result = ARGON2_INCORRECT_PARAMETER;
+                for (int impl = ARGON2_IMPL_AUTO; impl < MAX_ARGON2_IMPL; ++impl) {
+                    if (strcmp(argv[i], impl_names[impl]) == 0) {
+                        result = Argon2_SelectImpl((enum Argon2_impl) impl);
+                    }
+                }
+                if (result != ARGON2_OK) {
+                    printf("Implementation %s: %s\n", argv[i], ErrorMessage(result));
+                    return 1;
+                }
+                continue;
+            }
+        }
+
+        if (strcmp(argv[i], "-blake2b") == 0) {
+            if (i < argc - 1) {
+                i++;
+                int choice = (strcmp(argv[i], "sse41") == 0) ? BLAKE2B_COMPRESS_SSE41 : BLAKE2B_COMPRESS_PORTABLE;
+                if ((strcmp(argv[i], "portable") != 0 && strcmp(argv[i], "sse41") != 0) || 0 != blake2b_select_compress(choice)) {
+                    printf("BLAKE2b compression function %s: not supported\n", argv[i]);
+                    return 1;
+                }
+                continue;
+            }
+        }
+
         if (strcmp(argv[i], "-gen-tv") == 0) {
             generate_test_vectors = true;
             continue;
         }
 
         if (strcmp(argv[i], "-benchmark") == 0) {
-            Benchmark();
+            printf("The benchmarks are in argon2-bench (make argon2-bench), see argon2-bench -help\n");
             return 0;
         }
+
+        if (strcmp(argv[i], "-tune") == 0) {
+            if (i < argc - 2) {
+                tune_ms = atoi(argv[i + 1]);
+                tune_mib = atoi(argv[i + 2]);
+                i += 2;
+                continue;
+            }
+        }
+    }
+
+    if (tune_ms > 0) {
+        Tune(type, tune_ms, tune_mib, thread_n);
+        return 0;
     }
 
     if (generate_test_vectors) {